@@ -0,0 +1,102 @@
+#include "asyncNormals.h"
+
+#include "renderParam.h"
+
+#include <pxr/imaging/hd/smoothNormals.h>
+
+#include <nsi.hpp>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+HdNSIAsyncNormals::~HdNSIAsyncNormals()
+{
+	m_dispatcher.Wait();
+}
+
+/**
+	\brief Start computing the normals of a mesh.
+
+	A job already running for the same mesh is not stopped but its result
+	is dropped.
+*/
+void HdNSIAsyncNormals::Submit(
+	const std::string &handle,
+	const Hd_VertexAdjacency &adjacency,
+	const VtVec3fArray &points,
+	const VtIntArray &faceVertexIndices)
+{
+	unsigned serial;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		serial = ++m_serial;
+		Job &job = m_jobs[handle];
+		if (job.serial == 0)
+			++m_pending;
+		job = Job();
+		job.serial = serial;
+	}
+
+	/* The arrays are shared, not copied. The mesh may replace its own. */
+	m_dispatcher.Run(
+		[this, handle, serial, adjacency, points, faceVertexIndices]()
+		{
+			VtVec3fArray normals = Hd_SmoothNormals::ComputeSmoothNormals(
+				&adjacency, points.size(), points.cdata());
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto it = m_jobs.find(handle);
+			if (it == m_jobs.end() || it->second.serial != serial)
+				return;
+			it->second.done = true;
+			it->second.normals = normals;
+			it->second.indices = faceVertexIndices;
+		});
+}
+
+/**
+	\brief Forget the normals of a removed mesh.
+*/
+void HdNSIAsyncNormals::Cancel(const std::string &handle)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_jobs.find(handle);
+	if (it == m_jobs.end())
+		return;
+	m_jobs.erase(it);
+	--m_pending;
+}
+
+/**
+	\brief Send the normals which are ready.
+*/
+void HdNSIAsyncNormals::Flush(HdNSIRenderParam &renderParam)
+{
+	if (!IsPending())
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto it = m_jobs.begin(); it != m_jobs.end(); )
+	{
+		const Job &job = it->second;
+		if (!job.done)
+		{
+			++it;
+			continue;
+		}
+
+		renderParam.AcquireSceneForEdit().SetAttribute(it->first, (
+			*NSI::Argument("N")
+				.SetType(NSITypeNormal)
+				->SetCount(job.normals.size())
+				->SetValuePointer(job.normals.cdata()),
+			*NSI::Argument("N.indices")
+				.SetType(NSITypeInteger)
+				->SetCount(job.indices.size())
+				->SetValuePointer(job.indices.cdata())));
+		it = m_jobs.erase(it);
+		--m_pending;
+	}
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
@@ -0,0 +1,63 @@
+#ifndef HDNSI_ASYNCNORMALS_H
+#define HDNSI_ASYNCNORMALS_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/base/work/dispatcher.h>
+#include <pxr/imaging/hd/vertexAdjacency.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class HdNSIRenderParam;
+
+/*
+	Computes the smooth normals of deforming meshes in the background, for
+	interactive renders.
+
+	The mesh keeps the normals of its previous points until the new ones are
+	ready. They are then sent by Flush(), from CommitResources(), which
+	Hydra keeps calling as long as the render is not converged.
+*/
+class HdNSIAsyncNormals
+{
+public:
+	~HdNSIAsyncNormals();
+
+	void Submit(
+		const std::string &handle,
+		const Hd_VertexAdjacency &adjacency,
+		const VtVec3fArray &points,
+		const VtIntArray &faceVertexIndices);
+	void Cancel(const std::string &handle);
+
+	bool IsPending() const { return m_pending.load() != 0; }
+	void Flush(HdNSIRenderParam &renderParam);
+
+private:
+	struct Job
+	{
+		/* Identifies the latest job of a handle. */
+		unsigned serial{0};
+		bool done{false};
+		VtVec3fArray normals;
+		VtIntArray indices;
+	};
+
+	WorkDispatcher m_dispatcher;
+
+	std::mutex m_mutex;
+	std::unordered_map<std::string, Job> m_jobs;
+	unsigned m_serial{0};
+	/* Number of meshes with normals not sent yet. */
+	std::atomic<unsigned> m_pending{0};
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
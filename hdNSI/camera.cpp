@@ -1,9 +1,12 @@
 #include "camera.h"
 
+#include "frameReport.h"
 #include "renderDelegate.h"
 #include "renderParam.h"
 #include "rprimBase.h"
 
+#include <pxr/imaging/hd/light.h>
+#include <pxr/imaging/hd/renderIndex.h>
 #include <pxr/imaging/hd/renderPassState.h>
 #include <pxr/imaging/hd/sceneDelegate.h>
 
@@ -23,6 +26,9 @@ void HdNSICamera::Sync(
 	HdDirtyBits *dirtyBits)
 {
 	auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
+	HdNSIFrameReport::SyncTimer timer(
+		nsiRenderParam->GetRenderDelegate()->GetFrameReport(),
+		HdNSIFrameReport::k_camera);
 
 	/* Cache this because HdCamera clears all of them. */
 	auto bits = *dirtyBits;
@@ -114,6 +120,40 @@ void HdNSICamera::Sync(
 				data.SetShutterRange(GfRange1d{});
 			}
 		}
+
+		/*
+			Prims clip their motion samples to the shutters. If they now cover
+			another range, export them all again.
+		*/
+		if (nsiRenderParam->GetMotionSamples().SetCameraShutter(
+			GetId(), data.GetShutterRange()))
+		{
+			HdRenderIndex &index = sceneDelegate->GetRenderIndex();
+			HdChangeTracker &tracker = index.GetChangeTracker();
+			tracker.MarkAllRprimsDirty(
+				HdChangeTracker::DirtyTransform |
+				HdChangeTracker::DirtyPoints |
+				HdChangeTracker::DirtyPrimvar);
+			/*
+				And the lights. Cameras are the first sprims synced so they
+				are still to come.
+			*/
+			const TfToken light_types[] = {
+				HdPrimTypeTokens->cylinderLight,
+				HdPrimTypeTokens->diskLight,
+				HdPrimTypeTokens->distantLight,
+				HdPrimTypeTokens->domeLight,
+				HdPrimTypeTokens->rectLight,
+				HdPrimTypeTokens->sphereLight };
+			for (const TfToken &type : light_types)
+			{
+				for (const SdfPath &light : index.GetSprimSubtree(
+					type, SdfPath::AbsoluteRootPath()))
+				{
+					tracker.MarkSprimDirty(light, HdLight::DirtyTransform);
+				}
+			}
+		}
 	}
 
 	/* Do the necessary NSI calls for what was updated. */
@@ -130,17 +170,19 @@ HdDirtyBits HdNSICamera::GetInitialDirtyBitsMask() const
 void HdNSICamera::Finalize(HdRenderParam *renderParam)
 {
 	auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
-	NSI::Context &nsi = nsiRenderParam->AcquireSceneForEdit();
 
 	/*
 		Stop rendering in case the camera being deleted is the one being
 		rendered. Removal of cameras should be a rare enough event to not make
 		this a usability issue. If not, we'll have to check if it's actually
-		the one being rendered.
+		the one being rendered. There is nothing to stop during teardown.
 	*/
-	nsiRenderParam->StopRender();
+	if (!nsiRenderParam->IsDeferringDeletes())
+		nsiRenderParam->StopRender();
 
-	m_exported_data.Delete(nsi);
+	m_exported_data.Delete(nsiRenderParam);
+	/* A smaller range needs no export, the samples still cover it. */
+	nsiRenderParam->GetMotionSamples().RemoveCamera(GetId());
 
 	HdCamera::Finalize(renderParam);
 }
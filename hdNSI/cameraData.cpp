@@ -136,12 +136,12 @@ bool HdNSICameraData::UpdateExportedCamera(
 	\brief Delete the NSI nodes created for this object.
 */
 void HdNSICameraData::Delete(
-	NSI::Context &nsi)
+	HdNSIRenderParam *renderParam)
 {
-	nsi.Delete(m_camera_handle);
+	renderParam->DeleteNode(m_camera_handle);
 	m_camera_handle.clear();
 
-	nsi.Delete(m_xform_handle);
+	renderParam->DeleteNode(m_xform_handle);
 	m_xform_handle.clear();
 }
 
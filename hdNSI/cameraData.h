@@ -29,7 +29,7 @@ public:
 		HdNSIRenderParam *renderParam);
 
 	void Delete(
-		NSI::Context &nsi);
+		HdNSIRenderParam *renderParam);
 
 	bool IsNew() const { return m_new; }
 	void SetUsed() const { m_new = false; }
@@ -56,6 +56,7 @@ public:
 	void DisableDoF() { m_dof_enable = false; }
 
 	void SetShutterRange(const GfRange1d &r) { m_shutter_range = r; }
+	const GfRange1d& GetShutterRange() const { return m_shutter_range; }
 
 private:
 	bool IsPerspective() const;
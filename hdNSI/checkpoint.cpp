@@ -0,0 +1,282 @@
+#include "checkpoint.h"
+
+#include "renderBuffer.h"
+
+#include <pxr/base/arch/hash.h>
+#include <pxr/base/tf/atomicOfstreamWrapper.h>
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace
+{
+const char k_magic[8] = {'H', 'D', 'N', 'S', 'I', 'C', 'K', '1'};
+
+struct FileHeader
+{
+	char magic[8];
+	uint64_t key;
+	uint32_t rows;
+	uint32_t num_buffers;
+};
+
+struct BufferHeader
+{
+	uint32_t width;
+	uint32_t height;
+	int32_t format;
+	uint32_t pad{0};
+};
+
+/* Size of the top rows of a buffer, which are at its end in memory. */
+size_t RowsSize(const HdNSIRenderBuffer *buffer, unsigned rows)
+{
+	return size_t(rows) * buffer->GetWidth() *
+		HdDataSizeOfFormat(buffer->GetFormat());
+}
+
+size_t BufferSize(const HdNSIRenderBuffer *buffer)
+{
+	return RowsSize(buffer, buffer->GetHeight());
+}
+}
+
+HdNSICheckpoint::HdNSICheckpoint(
+	const std::string &directory,
+	double interval,
+	const std::string &key)
+:
+	m_directory{directory},
+	m_interval{std::max(interval, 1.0)},
+	m_key{key}
+{
+	TfMakeDirs(m_directory, -1, true);
+}
+
+HdNSICheckpoint::~HdNSICheckpoint()
+{
+	End(false);
+}
+
+/**
+	\brief Compute the key of a frame's checkpoint.
+
+	\param frame_description
+		Everything about the frame the delegate knows: resolution, camera,
+		outputs, frame number.
+
+	The scene content itself is not hashed, as that would mean another full
+	pass over it. The user given key (eg. a scene file and its version) is
+	what identifies it.
+*/
+size_t HdNSICheckpoint::ComputeKey(const std::string &frame_description) const
+{
+	/* Resuming is done by another run, maybe of another build. std::hash
+	   gives no guarantee across those. */
+	std::string key = m_key + '\n' + frame_description;
+	return ArchHash64(key.data(), key.size());
+}
+
+/**
+	\brief Load a checkpoint into the render buffers.
+
+	\returns
+		The number of complete rows, at the top of the image, which were
+		restored. 0 if there was no usable checkpoint.
+*/
+unsigned HdNSICheckpoint::Restore(
+	size_t key,
+	const std::vector<HdNSIRenderBuffer*> &buffers)
+{
+	std::ifstream in(FileName(key), std::ios::binary);
+	if (!in)
+		return 0;
+
+	FileHeader header;
+	in.read((char*)&header, sizeof(header));
+	if (!in ||
+	    !std::equal(k_magic, k_magic + sizeof(k_magic), header.magic) ||
+	    header.key != key ||
+	    header.num_buffers != buffers.size())
+	{
+		TF_WARN("Ignoring mismatched checkpoint '%s'", FileName(key).c_str());
+		return 0;
+	}
+
+	std::vector<std::vector<uint8_t>> data(buffers.size());
+	for (size_t i = 0; i < buffers.size(); ++i)
+	{
+		const HdNSIRenderBuffer *buffer = buffers[i];
+		BufferHeader bh;
+		in.read((char*)&bh, sizeof(bh));
+		if (!in ||
+		    bh.width != buffer->GetWidth() ||
+		    bh.height != buffer->GetHeight() ||
+		    bh.format != int32_t(buffer->GetFormat()) ||
+		    header.rows > bh.height)
+		{
+			TF_WARN("Ignoring mismatched checkpoint '%s'",
+				FileName(key).c_str());
+			return 0;
+		}
+		data[i].resize(RowsSize(buffer, header.rows));
+		in.read((char*)data[i].data(), data[i].size());
+		if (!in)
+		{
+			TF_WARN("Truncated checkpoint '%s'", FileName(key).c_str());
+			return 0;
+		}
+	}
+
+	/* Everything is valid. Fill the buffers. */
+	for (size_t i = 0; i < buffers.size(); ++i)
+	{
+		HdNSIRenderBuffer *buffer = buffers[i];
+		uint8_t *dst = (uint8_t*)buffer->Map();
+		memcpy(dst + BufferSize(buffer) - data[i].size(),
+			data[i].data(), data[i].size());
+		buffer->Unmap();
+		buffer->SetCompletedRows(header.rows);
+	}
+
+	return header.rows;
+}
+
+/**
+	\brief Start saving checkpoints of a render.
+*/
+void HdNSICheckpoint::Begin(
+	size_t key,
+	const std::vector<HdNSIRenderBuffer*> &buffers)
+{
+	End(false);
+
+	m_current_key = key;
+	m_buffers = buffers;
+	m_saved_rows = 0;
+	for (const HdNSIRenderBuffer *buffer : m_buffers)
+	{
+		m_saved_rows = std::max(m_saved_rows, buffer->GetCompletedRows());
+	}
+	m_stop = false;
+	m_thread = std::thread(&HdNSICheckpoint::SaveLoop, this);
+}
+
+/**
+	\brief Stop saving checkpoints.
+
+	\param completed
+		True if the render completed. Its checkpoint is then removed.
+		Otherwise, a last checkpoint is saved.
+*/
+void HdNSICheckpoint::End(bool completed)
+{
+	if (!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wakeup.notify_all();
+	m_thread.join();
+
+	if (completed)
+	{
+		std::string filename = FileName(m_current_key);
+		if (TfPathExists(filename))
+			TfDeleteFile(filename);
+	}
+	else
+	{
+		Save();
+	}
+	m_buffers.clear();
+}
+
+std::string HdNSICheckpoint::FileName(size_t key) const
+{
+	return TfStringCatPaths(m_directory, TfStringPrintf(
+		"hdnsi_%016llx.ckpt", (unsigned long long)key));
+}
+
+void HdNSICheckpoint::Save()
+{
+	if (m_buffers.empty())
+		return;
+
+	unsigned rows = m_buffers[0]->GetCompletedRows();
+	for (const HdNSIRenderBuffer *buffer : m_buffers)
+	{
+		rows = std::min(rows, buffer->GetCompletedRows());
+	}
+
+	/* Nothing new to save. */
+	if (rows <= m_saved_rows)
+		return;
+
+	std::string filename = FileName(m_current_key);
+	TfAtomicOfstreamWrapper wrapper(filename);
+	std::string reason;
+	if (!wrapper.Open(&reason))
+	{
+		TF_WARN("Unable to write checkpoint: %s", reason.c_str());
+		return;
+	}
+
+	std::ofstream &out = wrapper.GetStream();
+	FileHeader header;
+	std::copy(k_magic, k_magic + sizeof(k_magic), header.magic);
+	header.key = m_current_key;
+	header.rows = rows;
+	header.num_buffers = uint32_t(m_buffers.size());
+	out.write((const char*)&header, sizeof(header));
+
+	for (HdNSIRenderBuffer *buffer : m_buffers)
+	{
+		BufferHeader bh;
+		bh.width = buffer->GetWidth();
+		bh.height = buffer->GetHeight();
+		bh.format = int32_t(buffer->GetFormat());
+		out.write((const char*)&bh, sizeof(bh));
+
+		/* The completed rows are no longer written by the renderer. */
+		size_t size = RowsSize(buffer, rows);
+		const uint8_t *src = (const uint8_t*)buffer->Map();
+		out.write((const char*)src + BufferSize(buffer) - size, size);
+		buffer->Unmap();
+	}
+
+	if (!out || !wrapper.Commit(&reason))
+	{
+		TF_WARN("Unable to write checkpoint: %s", reason.c_str());
+		return;
+	}
+
+	m_saved_rows = rows;
+}
+
+void HdNSICheckpoint::SaveLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stop)
+	{
+		m_wakeup.wait_for(lock, std::chrono::duration<double>(m_interval));
+		if (m_stop)
+			break;
+		lock.unlock();
+		Save();
+		lock.lock();
+	}
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
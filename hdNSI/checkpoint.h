@@ -0,0 +1,69 @@
+#ifndef HDNSI_CHECKPOINT_H
+#define HDNSI_CHECKPOINT_H
+
+#include <pxr/pxr.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class HdNSIRenderBuffer;
+
+/*
+	Periodically saves the raster outputs of a batch render to disk so it can
+	be resumed if the process is killed.
+
+	This relies on the image being rendered in horizontal bucket order, one
+	sample set per pixel (non progressive). What is saved is the content of
+	the render buffers and the number of complete rows at the top of the image.
+	A resumed render only renders the remaining rows, using a crop window.
+*/
+class HdNSICheckpoint
+{
+public:
+	HdNSICheckpoint(
+		const std::string &directory,
+		double interval,
+		const std::string &key);
+	~HdNSICheckpoint();
+
+	/* Key which identifies one frame of a scene. */
+	size_t ComputeKey(const std::string &frame_description) const;
+
+	unsigned Restore(
+		size_t key,
+		const std::vector<HdNSIRenderBuffer*> &buffers);
+
+	void Begin(
+		size_t key,
+		const std::vector<HdNSIRenderBuffer*> &buffers);
+	void End(bool completed);
+
+private:
+	std::string FileName(size_t key) const;
+	void Save();
+	void SaveLoop();
+
+	std::string m_directory;
+	double m_interval;
+	std::string m_key;
+
+	/* State of the render being checkpointed. */
+	size_t m_current_key{0};
+	std::vector<HdNSIRenderBuffer*> m_buffers;
+	unsigned m_saved_rows{0};
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wakeup;
+	bool m_stop{false};
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
@@ -0,0 +1,119 @@
+#include "commandBuffer.h"
+
+#include "primvars.h"
+
+#include <algorithm>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/**
+	\brief Record an attribute set with HdNSIPrimvars::SetAttributeFromValue().
+
+	The value must be one that function accepts.
+*/
+void HdNSICommandBuffer::SetAttribute(
+	const std::string &handle,
+	const HdPrimvarDescriptor &primvar,
+	const VtValue &value,
+	int flags,
+	double time,
+	bool use_time)
+{
+	Command c;
+	c.type = Command::k_value;
+	c.handle = handle;
+	c.primvar = primvar;
+	c.value = value;
+	c.flags = flags;
+	c.time = time;
+	c.use_time = use_time;
+	m_commands.local().push_back(std::move(c));
+}
+
+/**
+	\brief Record the set of an integer array attribute (eg. indices).
+*/
+void HdNSICommandBuffer::SetIntArray(
+	const std::string &handle,
+	const std::string &name,
+	const VtIntArray &values)
+{
+	Command c;
+	c.type = Command::k_int_array;
+	c.handle = handle;
+	c.name = name;
+	c.value = VtValue(values);
+	m_commands.local().push_back(std::move(c));
+}
+
+void HdNSICommandBuffer::DeleteAttribute(
+	const std::string &handle,
+	const std::string &name)
+{
+	Command c;
+	c.type = Command::k_delete;
+	c.handle = handle;
+	c.name = name;
+	m_commands.local().push_back(std::move(c));
+}
+
+/**
+	\brief Send all the recorded commands and clear the buffers.
+
+	Must not be called while prims are being synced.
+*/
+void HdNSICommandBuffer::Flush(NSI::Context &nsi)
+{
+	std::vector<Command*> commands;
+	for (std::vector<Command> &local : m_commands)
+	{
+		for (Command &c : local)
+		{
+			commands.push_back(&c);
+		}
+	}
+	if (commands.empty())
+		return;
+
+	/* A node's commands all come from the thread which synced its prim. */
+	std::stable_sort(commands.begin(), commands.end(),
+		[](const Command *a, const Command *b)
+		{
+			return a->handle < b->handle;
+		});
+
+	for (Command *c : commands)
+	{
+		switch (c->type)
+		{
+		case Command::k_value:
+			HdNSIPrimvars::SetAttributeFromValue(
+				nsi, c->handle, c->primvar, c->value, c->flags,
+				c->time, c->use_time);
+			break;
+		case Command::k_int_array:
+		{
+			const VtIntArray &values = c->value.UncheckedGet<VtIntArray>();
+			nsi.SetAttribute(c->handle,
+				*NSI::Argument(c->name)
+				.SetType(NSITypeInteger)
+				->SetCount(values.size())
+				->SetValuePointer(values.cdata()));
+			break;
+		}
+		case Command::k_delete:
+			nsi.DeleteAttribute(c->handle, c->name);
+			break;
+		}
+		/* The renderer has its copy. Don't keep all of them until the end. */
+		c->value = VtValue();
+	}
+
+	for (std::vector<Command> &local : m_commands)
+	{
+		local.clear();
+	}
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
@@ -0,0 +1,76 @@
+#ifndef HDNSI_COMMANDBUFFER_H
+#define HDNSI_COMMANDBUFFER_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/vt/array.h>
+#include <pxr/base/vt/value.h>
+#include <pxr/imaging/hd/sceneDelegate.h>
+
+#include <nsi.hpp>
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/*
+	Records the bulk attribute edits of prims as they are synced, to be sent
+	to the renderer all at once after the sync.
+
+	Prims are synced in parallel but the renderer's API serializes calls on a
+	context. Recording is done in a buffer per thread, without a lock, and
+	keeps a reference on the exported arrays instead of copying them. The
+	buffers are replayed by Flush(), ordered by node handle so the exported
+	scene does not depend on thread scheduling.
+
+	Only the edits of existing nodes' attributes go through here. Nodes are
+	still created and connected directly, so they always exist before their
+	attributes are set.
+*/
+class HdNSICommandBuffer
+{
+public:
+	void SetAttribute(
+		const std::string &handle,
+		const HdPrimvarDescriptor &primvar,
+		const VtValue &value,
+		int flags,
+		double time,
+		bool use_time);
+
+	void SetIntArray(
+		const std::string &handle,
+		const std::string &name,
+		const VtIntArray &values);
+
+	void DeleteAttribute(
+		const std::string &handle,
+		const std::string &name);
+
+	void Flush(NSI::Context &nsi);
+
+private:
+	struct Command
+	{
+		enum Type { k_value, k_int_array, k_delete };
+
+		Type type;
+		std::string handle;
+		/* The attribute is given by primvar for k_value, by name otherwise. */
+		HdPrimvarDescriptor primvar;
+		std::string name;
+		VtValue value;
+		int flags;
+		double time;
+		bool use_time;
+	};
+
+	tbb::enumerable_thread_specific<std::vector<Command>> m_commands;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
@@ -26,6 +26,7 @@
 
 #include "curves.h"
 
+#include "frameReport.h"
 #include "renderDelegate.h"
 #include "renderParam.h"
 #include "renderPass.h"
@@ -80,6 +81,12 @@ HdNSICurves::GetInitialDirtyBitsMask() const
 HdDirtyBits
 HdNSICurves::_PropagateDirtyBits(HdDirtyBits bits) const
 {
+    /* A new material may read primvars which were not exported. */
+    if (_primvars.HasFilter() &&
+        0 != (bits & HdChangeTracker::DirtyMaterialId))
+    {
+        bits |= HdChangeTracker::DirtyPrimvar;
+    }
     return bits;
 }
 
@@ -117,6 +124,9 @@ HdNSICurves::Sync(HdSceneDelegate* sceneDelegate,
     // Pull top-level NSI state out of the render param.
     auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
     NSI::Context &nsi = nsiRenderParam->AcquireSceneForEdit();
+    HdNSIFrameReport::SyncTimer timer(
+        nsiRenderParam->GetRenderDelegate()->GetFrameReport(),
+        HdNSIFrameReport::k_curves);
 
     /* The base rprim class tracks this but does not update it itself. */
     if (HdChangeTracker::IsVisibilityDirty(*dirtyBits, GetId()))
@@ -152,6 +162,8 @@ HdNSICurves::_PopulateRtCurves(HdSceneDelegate* sceneDelegate,
             GetBasisCurvesTopology(sceneDelegate);
 
         const VtIntArray &vertexCounts = topology.GetCurveVertexCounts();
+        if (auto report = renderParam->GetRenderDelegate()->GetFrameReport())
+            report->Add(HdNSIFrameReport::k_curve_count, vertexCounts.size());
         nsi.SetAttribute(Shape(),
             *NSI::Argument("nvertices")
             .SetType(NSITypeInteger)
@@ -177,6 +189,13 @@ HdNSICurves::_PopulateRtCurves(HdSceneDelegate* sceneDelegate,
     _material.Sync(
         sceneDelegate, renderParam, dirtyBits, nsi, GetId(), Shape());
 
+    /* Only export the primvars which the material reads. */
+    if (HdChangeTracker::IsAnyPrimvarDirty(*dirtyBits, GetId()))
+    {
+        _primvars.SetFilter(_material.ReadPrimvars(
+            sceneDelegate, renderParam, *dirtyBits, GetId()));
+    }
+
     _primvars.Sync(
         sceneDelegate, renderParam, dirtyBits, nsi, GetId(),
         Shape(), VtIntArray()); // _curveVertexIndices ?
@@ -0,0 +1,373 @@
+#include "distributedRender.h"
+
+#include "renderBuffer.h"
+
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/arch/systemInfo.h>
+#include <pxr/base/gf/half.h>
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/imaging/hio/image.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#ifdef _WIN32
+#	define popen _popen
+#	define pclose _pclose
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace
+{
+/* Read a component of an image, as stored by Hio, as a float. */
+float ReadComponent(const uint8_t *data, HioType type, size_t i)
+{
+	switch (type)
+	{
+	case HioTypeUnsignedByte:
+		return data[i] / 255.0f;
+	case HioTypeHalfFloat:
+		return float(((const GfHalf*)data)[i]);
+	case HioTypeFloat:
+		return ((const float*)data)[i];
+	default:
+		return 0.0f;
+	}
+}
+
+/* Write a component in the form the output driver receives it. */
+void WriteComponent(uint8_t *data, HdFormat component_format, size_t i, float v)
+{
+	switch (component_format)
+	{
+	case HdFormatUNorm8:
+		data[i] = uint8_t(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+		break;
+	case HdFormatFloat16:
+		((GfHalf*)data)[i] = GfHalf(v);
+		break;
+	case HdFormatFloat32:
+	case HdFormatInt32:
+		/* Integer AOVs are rendered as float and converted by the driver. */
+		((float*)data)[i] = v;
+		break;
+	default:
+		break;
+	}
+}
+}
+
+HdNSIDistributedRender::HdNSIDistributedRender(
+	NSI::DynamicAPI &api,
+	unsigned workers,
+	const std::string &command,
+	const std::string &directory)
+:
+	m_api{api},
+	m_workers{std::max(workers, 1u)},
+	m_command{command},
+	m_directory{directory}
+{
+	TfMakeDirs(m_directory, -1, true);
+}
+
+/*
+	Remove the scene segments. The context writing the last one must already
+	be closed.
+*/
+HdNSIDistributedRender::~HdNSIDistributedRender()
+{
+	if (!m_open_segment.empty())
+		m_segments.push_back(m_open_segment);
+	for (const std::string &segment : m_segments)
+	{
+		if (TfIsFile(segment))
+			TfDeleteFile(segment);
+	}
+}
+
+/**
+	\brief Start a new scene segment.
+
+	\returns
+		The file to which the context must stream the following edits. The
+		previous segment, if any, must be closed.
+*/
+std::string HdNSIDistributedRender::BeginSceneSegment()
+{
+	if (!m_open_segment.empty())
+		m_segments.push_back(m_open_segment);
+	m_open_segment = TempFile(
+		TfStringPrintf("scene%u.nsi", unsigned(m_segments.size())));
+	return m_open_segment;
+}
+
+/**
+	\brief Render a frame with the workers and fill the render buffers.
+
+	\param screen
+		Handle of the screen to which the outputs are connected.
+	\param removed_nodes
+		Nodes the workers should delete. These are outputs (eg. file render
+		products) which can't be split across workers.
+	\returns
+		false if any part of the image could not be rendered.
+*/
+bool HdNSIDistributedRender::Render(
+	const std::string &screen,
+	const std::vector<Output> &outputs,
+	const std::vector<std::string> &removed_nodes,
+	unsigned width,
+	unsigned height)
+{
+	++m_frame;
+	unsigned workers = std::max(1u, std::min(m_workers, height));
+
+	/*
+		Each worker's band of whole rows. The crop is computed from them so
+		it gives the renderer the same rows MergeImage() expects.
+	*/
+	auto band_begin = [&](unsigned w) { return height * w / workers; };
+
+	std::vector<std::string> commands, streams, images;
+	for (unsigned w = 0; w < workers; ++w)
+	{
+		std::vector<std::string> worker_images;
+		for (size_t i = 0; i < outputs.size(); ++i)
+		{
+			worker_images.push_back(TempFile(TfStringPrintf(
+				"frame%u_worker%u_%u.exr", m_frame, w, unsigned(i))));
+		}
+		streams.push_back(TempFile(TfStringPrintf(
+			"frame%u_worker%u.nsi", m_frame, w)));
+		WriteWorkerStream(
+			streams.back(), screen, outputs, removed_nodes, worker_images,
+			float(band_begin(w)) / float(height),
+			float(band_begin(w + 1)) / float(height));
+		images.insert(images.end(), worker_images.begin(), worker_images.end());
+
+		std::string command = '"' + m_command + '"';
+		for (const std::string &segment : m_segments)
+			command += " \"" + segment + '"';
+		command += " \"" + streams.back() + "\" 2>&1";
+#ifdef _WIN32
+		/* cmd.exe strips the outer quotes. */
+		command = '"' + command + '"';
+#endif
+		commands.push_back(command);
+	}
+
+	bool ok = RunWorkers(commands);
+
+	/* Merge the bands, even if some failed, so what's there is shown. */
+	for (unsigned w = 0; w < workers; ++w)
+	{
+		unsigned y_begin = band_begin(w);
+		unsigned y_end = band_begin(w + 1);
+		for (size_t i = 0; i < outputs.size(); ++i)
+		{
+			const std::string &image = images[w * outputs.size() + i];
+			if (TfIsFile(image))
+			{
+				ok = MergeImage(image, outputs[i], y_begin, y_end) && ok;
+				TfDeleteFile(image);
+			}
+			else
+			{
+				ok = false;
+			}
+		}
+		TfDeleteFile(streams[w]);
+	}
+
+	return ok;
+}
+
+std::string HdNSIDistributedRender::TempFile(const std::string &name) const
+{
+	return TfStringCatPaths(m_directory, TfStringPrintf(
+		"hdnsi_%d_%s", ArchGetProcessId(), name.c_str()));
+}
+
+/*
+	Write the stream which turns the scene into one worker's part of the
+	frame. Only the screen's crop and the output drivers are changed.
+*/
+void HdNSIDistributedRender::WriteWorkerStream(
+	const std::string &filename,
+	const std::string &screen,
+	const std::vector<Output> &outputs,
+	const std::vector<std::string> &removed_nodes,
+	const std::vector<std::string> &images,
+	float crop_begin,
+	float crop_end) const
+{
+	NSI::Context nsi(m_api);
+	nsi.Begin((
+		NSI::StringArg("streamfilename", filename),
+		NSI::StringArg("streamformat", "nsi")));
+
+	float crop[2][2] = { { 0.0f, crop_begin }, { 1.0f, crop_end } };
+	NSI::ArgumentList args;
+	args.Add(NSI::Argument::New("crop")
+		->SetArrayType(NSITypeFloat, 2)
+		->SetCount(2)
+		->CopyValue(crop, sizeof(crop)));
+	nsi.SetAttribute(screen, args);
+
+	for (size_t i = 0; i < outputs.size(); ++i)
+	{
+		nsi.SetAttribute(outputs[i].driverHandle, (
+			NSI::StringArg("drivername", "exr"),
+			NSI::StringArg("imagefilename", images[i])));
+	}
+
+	for (const std::string &node : removed_nodes)
+	{
+		nsi.Delete(node);
+	}
+
+	nsi.RenderControl(NSI::CStringPArg("action", "start"));
+	nsi.RenderControl(NSI::CStringPArg("action", "wait"));
+	nsi.End();
+}
+
+/*
+	Run all the worker processes at once and wait for them. Their output is
+	read from a pipe and only shown if they fail.
+*/
+bool HdNSIDistributedRender::RunWorkers(
+	const std::vector<std::string> &commands)
+{
+	std::vector<FILE*> pipes;
+	for (const std::string &command : commands)
+	{
+		FILE *pipe = popen(command.c_str(), "r");
+		if (!pipe)
+			TF_WARN("Unable to start render worker: %s", command.c_str());
+		pipes.push_back(pipe);
+	}
+
+	/* Drain each pipe in its own thread so no worker blocks on its output. */
+	std::vector<std::string> output(pipes.size());
+	std::vector<int> status(pipes.size(), -1);
+	std::vector<std::thread> readers;
+	for (size_t i = 0; i < pipes.size(); ++i)
+	{
+		if (!pipes[i])
+			continue;
+		readers.emplace_back([&pipes, &output, &status, i]()
+		{
+			char buffer[4096];
+			size_t n;
+			while ((n = fread(buffer, 1, sizeof(buffer), pipes[i])) > 0)
+			{
+				output[i].append(buffer, n);
+			}
+			status[i] = pclose(pipes[i]);
+		});
+	}
+	for (std::thread &reader : readers)
+	{
+		reader.join();
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < pipes.size(); ++i)
+	{
+		if (status[i] != 0)
+		{
+			TF_WARN("Render worker %u failed:\n%s",
+				unsigned(i), output[i].c_str());
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+/*
+	Copy one worker's band of an output into its render buffer. The image is
+	either the full frame or only the cropped rows, depending on how the
+	driver wrote it.
+*/
+bool HdNSIDistributedRender::MergeImage(
+	const std::string &filename,
+	const Output &output,
+	unsigned y_begin,
+	unsigned y_end)
+{
+	HioImageSharedPtr image = HioImage::OpenForReading(filename);
+	if (!image)
+	{
+		TF_WARN("Unable to read '%s'", filename.c_str());
+		return false;
+	}
+
+	HdNSIRenderBuffer *buffer = output.buffer;
+	const unsigned width = buffer->GetWidth();
+	const unsigned band_height = y_end - y_begin;
+	unsigned first_row;
+	if (unsigned(image->GetWidth()) != width)
+		first_row = ~0u;
+	else if (unsigned(image->GetHeight()) == buffer->GetHeight())
+		first_row = y_begin;
+	else if (unsigned(image->GetHeight()) == band_height)
+		first_row = 0;
+	else
+		first_row = ~0u;
+	if (first_row == ~0u)
+	{
+		TF_WARN("Unexpected resolution in '%s'", filename.c_str());
+		return false;
+	}
+
+	HioImage::StorageSpec spec;
+	spec.width = image->GetWidth();
+	spec.height = image->GetHeight();
+	spec.depth = 1;
+	spec.format = image->GetFormat();
+	spec.flipped = false;
+	std::vector<uint8_t> pixels(
+		size_t(spec.width) * spec.height * image->GetBytesPerPixel());
+	spec.data = pixels.data();
+	if (!image->Read(spec))
+	{
+		TF_WARN("Unable to read '%s'", filename.c_str());
+		return false;
+	}
+
+	/* Convert the band to what the renderer would have sent the driver. */
+	const HioType in_type = HioGetHioType(spec.format);
+	const size_t in_components = HioGetComponentCount(spec.format);
+	const HdFormat out_format = HdGetComponentFormat(buffer->GetFormat());
+	const size_t out_components = HdGetComponentCount(buffer->GetFormat());
+	const int entry_size = int(HdDataSizeOfFormat(buffer->GetFormat()));
+	const size_t count = size_t(width) * band_height;
+	std::vector<uint8_t> band(count * entry_size);
+	const uint8_t *in = pixels.data() +
+		size_t(first_row) * width * image->GetBytesPerPixel();
+	for (size_t p = 0; p < count; ++p)
+	{
+		for (size_t c = 0; c < out_components; ++c)
+		{
+			float v = c < in_components
+				? ReadComponent(in, in_type, p * in_components + c)
+				: 0.0f;
+			WriteComponent(band.data(), out_format, p * out_components + c, v);
+		}
+	}
+
+	HdNSIOutputDriver::WriteRegion(
+		buffer, output.project,
+		0, int(width), int(y_begin), int(y_end),
+		entry_size, band.data());
+	return true;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
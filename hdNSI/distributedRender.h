@@ -0,0 +1,87 @@
+#ifndef HDNSI_DISTRIBUTEDRENDER_H
+#define HDNSI_DISTRIBUTEDRENDER_H
+
+#include "outputDriver.h"
+
+#include <pxr/pxr.h>
+
+#include <nsi.hpp>
+#include <nsi_dynamic.hpp>
+
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class HdNSIRenderBuffer;
+
+/*
+	Renders a batch frame with several local renderer processes.
+
+	The scene is not rendered by the delegate's own context. It is streamed
+	to files instead, one segment per frame with the edits since the previous
+	one. Each worker is a renderdl process given all the segments and a small
+	stream of its own which crops the screen to a band of rows and redirects
+	the raster outputs to image files. Once all workers are done, the bands
+	are read back into the render buffers through the output driver.
+*/
+class HdNSIDistributedRender
+{
+public:
+	HdNSIDistributedRender(
+		NSI::DynamicAPI &api,
+		unsigned workers,
+		const std::string &command,
+		const std::string &directory);
+	~HdNSIDistributedRender();
+
+	/* A raster output to fill. */
+	struct Output
+	{
+		std::string driverHandle;
+		HdNSIRenderBuffer *buffer;
+		/* Set for the depth output. */
+		const HdNSIOutputDriver::ProjData *project;
+	};
+
+	std::string BeginSceneSegment();
+
+	bool Render(
+		const std::string &screen,
+		const std::vector<Output> &outputs,
+		const std::vector<std::string> &removed_nodes,
+		unsigned width,
+		unsigned height);
+
+private:
+	std::string TempFile(const std::string &name) const;
+	void WriteWorkerStream(
+		const std::string &filename,
+		const std::string &screen,
+		const std::vector<Output> &outputs,
+		const std::vector<std::string> &removed_nodes,
+		const std::vector<std::string> &images,
+		float crop_begin,
+		float crop_end) const;
+	static bool RunWorkers(const std::vector<std::string> &commands);
+	static bool MergeImage(
+		const std::string &filename,
+		const Output &output,
+		unsigned y_begin,
+		unsigned y_end);
+
+	NSI::DynamicAPI &m_api;
+	unsigned m_workers;
+	std::string m_command;
+	std::string m_directory;
+
+	/* Complete scene segments, in order, and the one being written. */
+	std::vector<std::string> m_segments;
+	std::string m_open_segment;
+	unsigned m_frame{0};
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
@@ -0,0 +1,197 @@
+#include "frameReport.h"
+
+#include "outputDriver.h"
+
+#include <pxr/base/js/json.h>
+#include <pxr/base/tf/diagnostic.h>
+
+#include <fstream>
+
+#ifdef _WIN32
+#	include <windows.h>
+#	include <psapi.h>
+#else
+#	include <sys/resource.h>
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace
+{
+const char *k_prim_type_names[HdNSIFrameReport::k_num_prim_types] =
+{
+	"mesh", "curves", "points", "volume",
+	"instancer", "material", "light", "camera"
+};
+
+const char *k_stat_names[HdNSIFrameReport::k_num_stats] =
+{
+	"faces", "curves", "points", "instances", "primvar_bytes",
+	"skipped_bytes"
+};
+
+double Seconds(std::chrono::steady_clock::duration d)
+{
+	return std::chrono::duration<double>(d).count();
+}
+}
+
+HdNSIFrameReport::HdNSIFrameReport(const std::string &filename)
+:
+	m_filename{filename}
+{
+	for (auto &v : m_sync_ns) v = 0;
+	for (auto &v : m_sync_count) v = 0;
+	for (auto &v : m_stats) v = 0;
+	m_output_time = HdNSIOutputDriver::WriteTime();
+}
+
+void HdNSIFrameReport::AddSync(
+	PrimType type,
+	std::chrono::steady_clock::duration time)
+{
+	m_sync_ns[type].fetch_add(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(),
+		std::memory_order_relaxed);
+	m_sync_count[type].fetch_add(1, std::memory_order_relaxed);
+}
+
+void HdNSIFrameReport::RenderStarted()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_rendering = true;
+	m_render_start = std::chrono::steady_clock::now();
+	m_first_progress = false;
+	m_first_progress_time = -1.0;
+	m_render_time = -1.0;
+}
+
+/* Called from the renderer's progress callback. */
+void HdNSIFrameReport::Progress(float progress)
+{
+	if (progress <= 0.0f || m_first_progress.exchange(true))
+		return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_first_progress_time =
+		Seconds(std::chrono::steady_clock::now() - m_render_start);
+}
+
+void HdNSIFrameReport::RenderEnded()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_rendering)
+		return;
+	m_rendering = false;
+	m_render_time = Seconds(std::chrono::steady_clock::now() - m_render_start);
+	if (m_has_pending)
+		Write();
+}
+
+/**
+	\brief Record the end of a frame's sync.
+
+	The record is written once the frame's render is done, which may be now.
+
+	\param products
+		The files the frame writes, to identify it in the report.
+*/
+void HdNSIFrameReport::FrameDone(const std::vector<std::string> &products)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	/* The previous frame's render was never waited for. */
+	if (m_has_pending)
+		Write();
+
+	JsObject sync;
+	double sync_total = 0.0;
+	for (int i = 0; i < k_num_prim_types; ++i)
+	{
+		uint64_t count = m_sync_count[i].exchange(0);
+		double time = m_sync_ns[i].exchange(0) * 1e-9;
+		if (count == 0)
+			continue;
+		sync_total += time;
+		JsObject entry;
+		entry["count"] = JsValue(int64_t(count));
+		entry["seconds"] = JsValue(time);
+		sync[k_prim_type_names[i]] = JsValue(entry);
+	}
+
+	JsObject stats;
+	for (int i = 0; i < k_num_stats; ++i)
+	{
+		stats[k_stat_names[i]] = JsValue(int64_t(m_stats[i].exchange(0)));
+	}
+
+	JsArray files;
+	for (const std::string &p : products)
+	{
+		files.push_back(JsValue(p));
+	}
+
+	m_pending = JsObject();
+	m_pending["frame"] = JsValue(int(m_frame++));
+	m_pending["products"] = JsValue(files);
+	/* Sum of all prims' time. It exceeds wall time when synced in parallel. */
+	m_pending["sync_seconds"] = JsValue(sync_total);
+	m_pending["sync"] = JsValue(sync);
+	m_pending["scene"] = JsValue(stats);
+	m_has_pending = true;
+
+	if (!m_rendering)
+		Write();
+}
+
+/* Complete the pending record and append it to the file. */
+void HdNSIFrameReport::Write()
+{
+	if (m_render_time >= 0.0)
+		m_pending["render_seconds"] = JsValue(m_render_time);
+	if (m_first_progress_time >= 0.0)
+		m_pending["first_bucket_seconds"] = JsValue(m_first_progress_time);
+
+	double output_time = HdNSIOutputDriver::WriteTime();
+	m_pending["output_seconds"] = JsValue(output_time - m_output_time);
+	m_output_time = output_time;
+
+	m_pending["peak_memory_mb"] = JsValue(PeakResidentMB());
+
+	std::ofstream file(m_filename, std::ios::app);
+	if (!file)
+	{
+		TF_WARN("Unable to write frame report '%s'", m_filename.c_str());
+	}
+	else
+	{
+		file << JsWriteToString(JsValue(m_pending)) << std::endl;
+	}
+
+	m_pending = JsObject();
+	m_has_pending = false;
+	m_render_time = -1.0;
+	m_first_progress_time = -1.0;
+}
+
+double HdNSIFrameReport::PeakResidentMB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0.0;
+	return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+#	ifdef __APPLE__
+	/* Bytes on macOS. */
+	return usage.ru_maxrss / (1024.0 * 1024.0);
+#	else
+	/* KB on Linux. */
+	return usage.ru_maxrss / 1024.0;
+#	endif
+#endif
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
@@ -0,0 +1,118 @@
+#ifndef HDNSI_FRAMEREPORT_H
+#define HDNSI_FRAMEREPORT_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/js/value.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/*
+	Collects performance numbers of batch frames and appends them to a file,
+	as one JSON object per line (JSON Lines).
+
+	Everything is gathered with atomic counters as prims are synced in
+	parallel. A frame's record is completed once its render has been waited
+	for, which may happen after the next frame started syncing when batch
+	frames are pipelined.
+*/
+class HdNSIFrameReport
+{
+public:
+	explicit HdNSIFrameReport(const std::string &filename);
+
+	enum PrimType
+	{
+		k_mesh,
+		k_curves,
+		k_points,
+		k_volume,
+		k_instancer,
+		k_material,
+		k_light,
+		k_camera,
+		k_num_prim_types
+	};
+
+	enum Stat
+	{
+		k_faces,
+		k_curve_count,
+		k_point_count,
+		k_instances,
+		k_primvar_bytes,
+		k_skipped_bytes,
+		k_num_stats
+	};
+
+	/* Measures one prim's Sync(). Does nothing without a report. */
+	class SyncTimer
+	{
+	public:
+		SyncTimer(HdNSIFrameReport *report, PrimType type)
+		:
+			m_report{report},
+			m_type{type}
+		{
+			if (m_report)
+				m_start = std::chrono::steady_clock::now();
+		}
+		~SyncTimer()
+		{
+			if (m_report)
+				m_report->AddSync(m_type, std::chrono::steady_clock::now() - m_start);
+		}
+
+	private:
+		HdNSIFrameReport *m_report;
+		PrimType m_type;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	void Add(Stat stat, uint64_t value)
+	{
+		m_stats[stat].fetch_add(value, std::memory_order_relaxed);
+	}
+
+	void RenderStarted();
+	void Progress(float progress);
+	void RenderEnded();
+	void FrameDone(const std::vector<std::string> &products);
+
+private:
+	void AddSync(PrimType type, std::chrono::steady_clock::duration time);
+	void Write();
+
+	static double PeakResidentMB();
+
+	std::string m_filename;
+	unsigned m_frame{0};
+
+	std::atomic<uint64_t> m_sync_ns[k_num_prim_types];
+	std::atomic<uint64_t> m_sync_count[k_num_prim_types];
+	std::atomic<uint64_t> m_stats[k_num_stats];
+
+	std::mutex m_mutex;
+	/* The record of the last frame, until its render is done. */
+	JsObject m_pending;
+	bool m_has_pending{false};
+
+	bool m_rendering{false};
+	std::chrono::steady_clock::time_point m_render_start;
+	std::atomic<bool> m_first_progress{false};
+	double m_first_progress_time{-1.0};
+	double m_render_time{-1.0};
+	/* HdNSIOutputDriver::WriteTime() when the last record was written. */
+	double m_output_time{0.0};
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
@@ -0,0 +1,146 @@
+#include "geometryCache.h"
+
+#include "valueTypes.h"
+
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/arch/hash.h>
+#include <pxr/base/arch/systemInfo.h>
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/imaging/hd/meshTopology.h>
+
+#include <atomic>
+#include <cstdio>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace
+{
+/* Bump this when the exported data changes, to invalidate old entries. */
+const unsigned k_cache_version = 2;
+
+template <typename T>
+size_t HashArray(const VtArray<T> &a, size_t seed)
+{
+	return HdNSIValueTypes::Hash(VtValue(a), seed);
+}
+}
+
+HdNSIGeometryCache::HdNSIGeometryCache(
+	NSI::DynamicAPI &api,
+	const std::string &directory)
+:
+	m_api{api},
+	m_directory{directory}
+{
+	TfMakeDirs(m_directory, -1, true);
+}
+
+/**
+	\brief Load a cached geometry into a context.
+
+	\returns
+		false if the key is not in the cache.
+*/
+bool HdNSIGeometryCache::Load(NSI::Context &nsi, size_t key) const
+{
+	std::string file = ArchivePath(key);
+	if (!TfIsFile(file))
+		return false;
+
+	Evaluate(nsi, file);
+	return true;
+}
+
+/**
+	\brief Start writing a new cache entry.
+*/
+std::unique_ptr<HdNSIGeometryCache::Archive> HdNSIGeometryCache::BeginArchive(
+	size_t key) const
+{
+	/* Prims are synced in parallel so temporary names must be unique. */
+	static std::atomic<unsigned> counter{0};
+
+	std::unique_ptr<Archive> archive{new Archive};
+	archive->m_file = ArchivePath(key);
+	archive->m_tmpfile = TfStringPrintf("%s.%d.%u.tmp",
+		archive->m_file.c_str(), ArchGetProcessId(), ++counter);
+	archive->m_context.reset(new NSI::Context(m_api));
+	archive->m_context->Begin((
+		NSI::StringArg("streamfilename", archive->m_tmpfile),
+		NSI::StringArg("streamformat", "binarynsi")));
+	return archive;
+}
+
+/**
+	\brief Complete a cache entry and load it into the scene.
+*/
+void HdNSIGeometryCache::EndArchive(
+	std::unique_ptr<Archive> archive,
+	NSI::Context &nsi) const
+{
+	/* Flush the stream. */
+	archive->m_context->End();
+	archive->m_context.reset();
+
+	/*
+		Another process may have written the same entry in the meantime. Its
+		content is the same so it does not matter which one is kept.
+	*/
+	if (std::rename(archive->m_tmpfile.c_str(), archive->m_file.c_str()) != 0)
+	{
+		TF_WARN("Unable to write geometry cache '%s'",
+			archive->m_file.c_str());
+		Evaluate(nsi, archive->m_tmpfile);
+		TfDeleteFile(archive->m_tmpfile);
+		return;
+	}
+
+	Evaluate(nsi, archive->m_file);
+}
+
+std::string HdNSIGeometryCache::ArchivePath(size_t key) const
+{
+	return TfStringCatPaths(m_directory, TfStringPrintf(
+		"hdnsi_v%u_%016llx.nsib", k_cache_version, (unsigned long long)key));
+}
+
+void HdNSIGeometryCache::Evaluate(NSI::Context &nsi, const std::string &file)
+{
+	nsi.Evaluate((
+		NSI::StringArg("type", "apistream"),
+		NSI::StringArg("filename", file)));
+}
+
+size_t HdNSIGeometryCache::Hash(const std::string &s, size_t seed)
+{
+	return ArchHash64(s.data(), s.size(), seed);
+}
+
+size_t HdNSIGeometryCache::Hash(const HdMeshTopology &topology)
+{
+	size_t hash = Hash(topology.GetScheme().GetString());
+	hash = Hash(topology.GetOrientation().GetString(), hash);
+	hash = HashArray(topology.GetFaceVertexCounts(), hash);
+	hash = HashArray(topology.GetFaceVertexIndices(), hash);
+	hash = HashArray(topology.GetHoleIndices(), hash);
+	return hash;
+}
+
+size_t HdNSIGeometryCache::Hash(const PxOsdSubdivTags &tags)
+{
+	size_t hash = Hash(tags.GetVertexInterpolationRule().GetString());
+	hash = Hash(tags.GetFaceVaryingInterpolationRule().GetString(), hash);
+	hash = Hash(tags.GetCreaseMethod().GetString(), hash);
+	hash = Hash(tags.GetTriangleSubdivision().GetString(), hash);
+	hash = HashArray(tags.GetCreaseIndices(), hash);
+	hash = HashArray(tags.GetCreaseLengths(), hash);
+	hash = HashArray(tags.GetCreaseWeights(), hash);
+	hash = HashArray(tags.GetCornerIndices(), hash);
+	hash = HashArray(tags.GetCornerWeights(), hash);
+	return hash;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
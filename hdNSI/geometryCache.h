@@ -0,0 +1,75 @@
+#ifndef HDNSI_GEOMETRYCACHE_H
+#define HDNSI_GEOMETRYCACHE_H
+
+#include <pxr/pxr.h>
+
+#include <nsi.hpp>
+#include <nsi_dynamic.hpp>
+
+#include <memory>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class HdMeshTopology;
+class PxOsdSubdivTags;
+
+/*
+	On disk cache of exported geometry, shared between sessions.
+
+	Each entry is an NSI stream holding the attributes of one geometry node,
+	keyed by a hash of the prim's path and all of its data. A prim whose key is
+	found is loaded by having the renderer evaluate the stream, instead of
+	being exported again. Entries are written by exporting the prim into a
+	separate stream context, which is then evaluated the same way.
+*/
+class HdNSIGeometryCache
+{
+public:
+	HdNSIGeometryCache(
+		NSI::DynamicAPI &api,
+		const std::string &directory);
+
+	/* An archive being written. Export the geometry to Context(). */
+	class Archive
+	{
+	public:
+		NSI::Context& Context() { return *m_context; }
+
+	private:
+		friend class HdNSIGeometryCache;
+		std::unique_ptr<NSI::Context> m_context;
+		std::string m_tmpfile;
+		std::string m_file;
+	};
+
+	bool Load(NSI::Context &nsi, size_t key) const;
+
+	std::unique_ptr<Archive> BeginArchive(size_t key) const;
+	void EndArchive(std::unique_ptr<Archive> archive, NSI::Context &nsi) const;
+
+	static size_t Combine(size_t seed, size_t value)
+	{
+		return seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+	}
+
+	/*
+		Hashes for keys. They are the same in every session, which the
+		hashes of USD's own types are not.
+	*/
+	static size_t Hash(const std::string &s, size_t seed = 0);
+	static size_t Hash(const HdMeshTopology &topology);
+	static size_t Hash(const PxOsdSubdivTags &tags);
+
+private:
+	std::string ArchivePath(size_t key) const;
+	static void Evaluate(NSI::Context &nsi, const std::string &file);
+
+	NSI::DynamicAPI &m_api;
+	std::string m_directory;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
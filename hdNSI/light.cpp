@@ -1,5 +1,6 @@
 #include "light.h"
 
+#include "frameReport.h"
 #include "renderDelegate.h"
 #include "renderParam.h"
 #include "rprimBase.h"
@@ -30,6 +31,9 @@ void HdNSILight::Sync(
 {
 	auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
 	NSI::Context &nsi = nsiRenderParam->AcquireSceneForEdit();
+	HdNSIFrameReport::SyncTimer timer(
+		nsiRenderParam->GetRenderDelegate()->GetFrameReport(),
+		HdNSIFrameReport::k_light);
 
 	std::string xform_handle = GetId().GetString();
 	std::string geo_handle = xform_handle + "|geo";
@@ -43,7 +47,8 @@ void HdNSILight::Sync(
 	if (0 != (*dirtyBits & DirtyTransform))
 	{
 		HdNSIRprimBase::ExportTransform(
-			sceneDelegate, GetId(), false, nsi, xform_handle);
+			sceneDelegate, GetId(), false,
+			nsiRenderParam->GetMotionSamples(), nsi, xform_handle);
 	}
 
 	if (0 != (*dirtyBits & DirtyParams))
@@ -118,9 +123,7 @@ void HdNSILight::Sync(
 
 void HdNSILight::Finalize(HdRenderParam *renderParam)
 {
-	auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
-	NSI::Context &nsi = nsiRenderParam->AcquireSceneForEdit();
-	DeleteNodes(nsiRenderParam, nsi);
+	DeleteNodes(static_cast<HdNSIRenderParam*>(renderParam));
 }
 
 HdDirtyBits HdNSILight::GetInitialDirtyBitsMask() const
@@ -199,8 +202,7 @@ void HdNSILight::CreateNodes(
 	Delete all the nodes added to the scene for the light.
 */
 void HdNSILight::DeleteNodes(
-	HdNSIRenderParam *renderParam,
-	NSI::Context &i_nsi)
+	HdNSIRenderParam *renderParam)
 {
 	if (!m_nodes_created)
 		return;
@@ -210,13 +212,13 @@ void HdNSILight::DeleteNodes(
 	std::string attr_handle = xform_handle + "|attr";
 	std::string shader_handle = xform_handle + "|shader";
 
-	i_nsi.Delete(xform_handle);
-	i_nsi.Delete(geo_handle);
-	i_nsi.Delete(attr_handle);
-	i_nsi.Delete(shader_handle);
+	renderParam->DeleteNode(xform_handle);
+	renderParam->DeleteNode(geo_handle);
+	renderParam->DeleteNode(attr_handle);
+	renderParam->DeleteNode(shader_handle);
 	if( !m_linking_attr_handle.empty() )
 	{
-		i_nsi.Delete(m_linking_attr_handle);
+		renderParam->DeleteNode(m_linking_attr_handle);
 		m_linking_attr_handle.clear();
 	}
 
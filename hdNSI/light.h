@@ -31,8 +31,7 @@ private:
 		NSI::Context &i_nsi);
 
 	void DeleteNodes(
-		HdNSIRenderParam *renderParam,
-		NSI::Context &i_nsi);
+		HdNSIRenderParam *renderParam);
 
 	void SetShaderParams(
 		NSI::Context &i_nsi,
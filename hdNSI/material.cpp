@@ -1,8 +1,13 @@
 #include "material.h"
+#include "frameReport.h"
 #include "renderDelegate.h"
 #include "renderParam.h"
+#include "valueTypes.h"
 
+#include <pxr/base/tf/stringUtils.h>
 #include <pxr/usd/sdf/assetPath.h>
+#include <pxr/imaging/hd/changeTracker.h>
+#include <pxr/imaging/hd/renderIndex.h>
 #include <pxr/imaging/hd/sceneDelegate.h>
 
 #include <cstring>
@@ -43,9 +48,13 @@ void HdNSIMaterial::Sync(
 {
 	auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
 	NSI::Context &nsi = nsiRenderParam->AcquireSceneForEdit();
+	HdNSIFrameReport::SyncTimer timer(
+		nsiRenderParam->GetRenderDelegate()->GetFrameReport(),
+		HdNSIFrameReport::k_material);
 
 	std::string mat_handle = GetId().GetString() + "|mat";
 
+	bool first_sync = !m_attributes_created;
 	if (!m_attributes_created)
 	{
 		nsi.Create(mat_handle, "attributes");
@@ -62,6 +71,16 @@ void HdNSIMaterial::Sync(
 				nsi, nsiRenderParam,
 				v.Get<HdMaterialNetworkMap>());
 		}
+
+		/*
+			Prims export only the primvars their material reads. Those bound
+			to this one must get the primvars it now reads too.
+		*/
+		if (UpdateReadPrimvars(nsiRenderParam) && !first_sync)
+		{
+			sceneDelegate->GetRenderIndex().GetChangeTracker()
+				.MarkAllRprimsDirty(HdChangeTracker::DirtyPrimvar);
+		}
 	}
 
 	*dirtyBits = Clean;
@@ -143,7 +162,7 @@ void HdNSIMaterial::UseDefaultShader(
 	if (use_default)
 	{
 		/* Delete anything we exported previously. */
-		DeleteShaderNodes(nsi);
+		DeleteShaderNodes(renderParam);
 		/*
 			Connect the default material network. This case (an empty material
 			resource) is what happens when materials are disabled globally by
@@ -167,16 +186,15 @@ void HdNSIMaterial::UseDefaultShader(
 void HdNSIMaterial::Finalize(HdRenderParam *renderParam)
 {
 	auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
-	NSI::Context &nsi = nsiRenderParam->AcquireSceneForEdit();
 
 	std::string mat_handle = GetId().GetString() + "|mat";
 
 	if (m_attributes_created)
 	{
-		nsi.Delete(mat_handle);
+		nsiRenderParam->DeleteNode(mat_handle);
 		m_attributes_created = false;
 	}
-	DeleteShaderNodes(nsi);
+	DeleteShaderNodes(nsiRenderParam);
 }
 
 HdDirtyBits HdNSIMaterial::GetInitialDirtyBitsMask() const
@@ -304,6 +322,139 @@ void HdNSIMaterial::ExportNetworks(
 
 }
 
+/**
+	\brief Find which primvars the material can read.
+
+	\returns
+		true if they changed.
+*/
+bool HdNSIMaterial::UpdateReadPrimvars(HdNSIRenderParam *renderParam)
+{
+	HdNSIRenderDelegate *delegate = renderParam->GetRenderDelegate();
+	std::shared_ptr<const TfToken::Set> read;
+	if (m_use_default_shader)
+	{
+		read = delegate->GetDefaultMaterialPrimvars();
+	}
+	else if (delegate->GetKeptPrimvars())
+	{
+		TfToken::Set names = *delegate->GetKeptPrimvars();
+		bool known = true;
+		for (const HdMaterialNetwork *network :
+			{&m_surface_network, &m_displacement_network, &m_volume_network})
+		{
+			known = known && NetworkReadPrimvars(renderParam, *network, names);
+		}
+		if (known)
+		{
+			read = std::make_shared<const TfToken::Set>(std::move(names));
+		}
+	}
+
+	bool changed = !read || !m_read_primvars
+		? read != m_read_primvars
+		: *read != *m_read_primvars;
+	m_read_primvars = read;
+	return changed;
+}
+
+/*
+	Add the primvars which the shaders of a network read to a set.
+
+	OSL does not tell which attributes a shader gets so shaders must declare
+	them with metadata: "primvars" on the shader lists the ones it always
+	reads and "primvar" flags a string parameter naming one, like varname on
+	UsdPrimvarReader_*. A shader without the former could read anything.
+
+	\returns
+		false if the network could read any primvar.
+*/
+bool HdNSIMaterial::NetworkReadPrimvars(
+	HdNSIRenderParam *renderParam,
+	const HdMaterialNetwork &network,
+	TfToken::Set &read) const
+{
+	HdNSIRenderDelegate *delegate = renderParam->GetRenderDelegate();
+	for (const HdMaterialNode &node : network.nodes)
+	{
+		std::string shader = delegate->FindShader(node.identifier);
+		/* Not exported. See ExportNode(). */
+		if (shader.empty())
+			continue;
+
+		DlShaderInfo *si = delegate->GetShaderInfo(shader);
+		if (!si)
+			return false;
+
+		bool declared = false;
+		for (const auto &meta : si->metadata())
+		{
+			if (meta.name == "primvars" && meta.type.IsOneString())
+			{
+				declared = true;
+				for (const std::string &name :
+					TfStringTokenize(meta.sdefault[0].string()))
+				{
+					read.insert(TfToken(name));
+				}
+			}
+		}
+		if (!declared)
+			return false;
+
+		auto connected = [&](const DlShaderInfo::Parameter &param)
+		{
+			for (const HdMaterialRelationship &r : network.relationships)
+			{
+				if (r.outputId == node.path &&
+				    EscapeOSLKeyword(DecodeArrayIndex(
+				        r.outputName.GetString())) == param.name.string())
+				{
+					return true;
+				}
+			}
+			return false;
+		};
+
+		for (const auto &param : si->params())
+		{
+			for (const auto &meta : param.metadata)
+			{
+				/* The default shader is not known. See ExportNode(). */
+				if (meta.name == "default_connection" && !connected(param))
+					return false;
+				if (meta.name != "primvar")
+					continue;
+				/* Nor is a name computed by another shader. */
+				if (connected(param))
+					return false;
+
+				auto value = node.parameters.find(
+					TfToken(param.name.string()));
+				std::string name;
+				if (value == node.parameters.end())
+				{
+					if (param.sdefault.size() == 1)
+						name = param.sdefault[0].string();
+				}
+				else if (value->second.IsHolding<TfToken>())
+				{
+					name = value->second.UncheckedGet<TfToken>().GetString();
+				}
+				else if (value->second.IsHolding<std::string>())
+				{
+					name = value->second.UncheckedGet<std::string>();
+				}
+				if (!name.empty())
+				{
+					read.insert(TfToken(name));
+				}
+			}
+		}
+	}
+	return true;
+}
+
 namespace
 {
 /* Changes "<UDIM>" to "UDIM" in the path so both will be recognized. */
@@ -453,77 +604,22 @@ void HdNSIMaterial::ExportNode(
 	args.Add(new NSI::StringArg("shaderfilename", shader));
 	for (auto &p : exported_node.parameters)
 	{
-		std::string name = p.first.GetString();
-		const VtValue &v = p.second;
-
-		name = EscapeOSLKeyword(name);
-
-		if (v.IsHolding<TfToken>())
-		{
-			args.Add(new NSI::StringArg(name, v.Get<TfToken>().GetString()));
-		}
-		else if (v.IsHolding<std::string>())
+		VtValue &v = p.second;
+		if (v.IsHolding<SdfAssetPath>())
 		{
-			args.Add(new NSI::StringArg(name, v.Get<std::string>()));
+			v = FixUDIM(v.UncheckedGet<SdfAssetPath>().GetResolvedPath());
 		}
-		else if (v.IsHolding<float>())
-		{
-			args.Add(new NSI::FloatArg(name, v.Get<float>()));
-		}
-		else if (v.IsHolding<GfVec3f>())
-		{
-			args.Add(new NSI::ColorArg(name, v.Get<GfVec3f>().data()));
-		}
-		else if (v.IsHolding<GfVec4f>())
-		{
-			args.Add(
-				NSI::Argument::New(name)
-				->SetArrayType(NSITypeFloat, 4)
-				->CopyValue(v.Get<GfVec4f>().data(), sizeof(float)*4));
-		}
-		else if (v.IsHolding<int>())
-		{
-			args.Add(new NSI::IntegerArg(name, v.Get<int>()));
-		}
-		else if (v.IsHolding<SdfAssetPath>())
-		{
-			std::string path = v.Get<SdfAssetPath>().GetResolvedPath();
-			path = FixUDIM(path);
-			args.Add(new NSI::StringArg(name, path));
-		}
-		else if (v.IsHolding<VtArray<std::string>>())
-		{
-			const auto &v_array = v.Get<VtArray<std::string>>();
-			NSI::Argument *a = new NSI::Argument(name);
-			a->SetArrayType(NSITypeString, v_array.size());
-			const char **values = reinterpret_cast<const char **>(
-				a->AllocValue(sizeof(char*) * v_array.size()));
-			for( size_t i = 0; i < v_array.size(); ++i )
-			{
-				values[i] = v_array[i].c_str();
-			}
-			args.Add(a);
-		}
-		else if (v.IsHolding<VtArray<float>>())
-		{
-			const auto &v_array = v.Get<VtArray<float>>();
-			args.Add(NSI::Argument::New(name)
-				->SetArrayType(NSITypeFloat, v_array.size())
-				->SetValuePointer(v_array.cdata()));
-		}
-		else if (v.IsHolding<VtArray<GfVec3f>>())
+
+		NSI::Argument *arg =
+			new NSI::Argument(EscapeOSLKeyword(p.first.GetString()));
+		if (HdNSIValueTypes::FillArgument(
+				*arg, v, TfToken(), HdNSIValueTypes::k_shader_parameter))
 		{
-			const auto &v_array = v.Get<VtArray<GfVec3f>>();
-			args.Add(NSI::Argument::New(name)
-				->SetArrayType(NSITypeColor, v_array.size())
-				->SetValuePointer(v_array.cdata()->data()));
+			args.Add(arg);
 		}
-		else if (v.IsHolding<VtArray<int>>())
+		else
 		{
-			const auto &v_array = v.Get<VtArray<int>>();
-			args.Add(NSI::Argument::New(name)
-				->SetArrayType(NSITypeInteger, v_array.size())
-				->SetValuePointer(v_array.cdata()));
+			delete arg;
 		}
 	}
 	nsi.SetAttribute(node_handle, args);
@@ -533,11 +629,17 @@ void HdNSIMaterial::ExportNode(
 /*
 	Delete all the shader nodes exported for this material.
 */
-void HdNSIMaterial::DeleteShaderNodes(NSI::Context &nsi)
+void HdNSIMaterial::DeleteShaderNodes(HdNSIRenderParam *renderParam)
 {
-	DeleteOneNetwork(nsi, m_surface_network, {});
-	DeleteOneNetwork(nsi, m_displacement_network, {});
-	DeleteOneNetwork(nsi, m_volume_network, {});
+	for (HdMaterialNetwork *network :
+		{&m_surface_network, &m_displacement_network, &m_volume_network})
+	{
+		for (const HdMaterialNode &node : network->nodes)
+		{
+			renderParam->DeleteNode(node.path.GetString());
+		}
+		*network = HdMaterialNetwork();
+	}
 }
 
 /*
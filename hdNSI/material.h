@@ -62,6 +62,10 @@ public:
 
 	static const std::array<TfToken, 6>& VolumeNodeParameters();
 
+	/* The primvars the material can read. Null when it can read any. */
+	const std::shared_ptr<const TfToken::Set>& GetReadPrimvars() const
+		{ return m_read_primvars; }
+
 private:
 	struct DefaultConnectionList;
 
@@ -82,7 +86,13 @@ private:
 		const HdMaterialNode &node,
 		DefaultConnectionList &default_connections);
 
-	void DeleteShaderNodes(NSI::Context &nsi);
+	bool UpdateReadPrimvars(HdNSIRenderParam *renderParam);
+	bool NetworkReadPrimvars(
+		HdNSIRenderParam *renderParam,
+		const HdMaterialNetwork &network,
+		TfToken::Set &read) const;
+
+	void DeleteShaderNodes(HdNSIRenderParam *renderParam);
 	void DeleteOneNetwork(
 		NSI::Context &nsi,
 		HdMaterialNetwork &network,
@@ -106,6 +116,8 @@ private:
 	std::shared_ptr<VolumeCallbacks> m_volume_callbacks;
 	/* Mutex to initialize m_volume_callbacks. */
 	std::mutex m_volume_callbacks_mutex;
+	/* See GetReadPrimvars(). Only computed when primvars are filtered. */
+	std::shared_ptr<const TfToken::Set> m_read_primvars;
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
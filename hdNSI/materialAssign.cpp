@@ -1,8 +1,11 @@
 #include "materialAssign.h"
 
+#include "material.h"
 #include "renderDelegate.h"
 #include "renderParam.h"
 
+#include <pxr/imaging/hd/renderIndex.h>
+
 PXR_NAMESPACE_OPEN_SCOPE
 
 void HdNSIMaterialAssign::Sync(
@@ -45,6 +48,37 @@ void HdNSIMaterialAssign::Sync(
 	*dirtyBits &= ~HdDirtyBits(HdChangeTracker::DirtyMaterialId);
 }
 
+/**
+	\brief Get the primvars read by the prim's material.
+
+	\returns
+		The names of the primvars to export, or null to export all of them.
+
+	This may be called before Sync() so the binding is read again when it
+	changed. The material was synced already, as sprims come first.
+*/
+std::shared_ptr<const TfToken::Set> HdNSIMaterialAssign::ReadPrimvars(
+	HdSceneDelegate *sceneDelegate,
+	HdNSIRenderParam *renderParam,
+	HdDirtyBits dirtyBits,
+	const SdfPath &primId) const
+{
+	HdNSIRenderDelegate *delegate = renderParam->GetRenderDelegate();
+	if (!delegate->GetKeptPrimvars())
+		return nullptr;
+
+	SdfPath materialId = 0 != (dirtyBits & HdChangeTracker::DirtyMaterialId)
+		? sceneDelegate->GetMaterialId(primId)
+		: m_materialId;
+	if (materialId.IsEmpty())
+		return delegate->GetDefaultMaterialPrimvars();
+
+	auto material = static_cast<const HdNSIMaterial*>(
+		sceneDelegate->GetRenderIndex().GetSprim(
+			HdPrimTypeTokens->material, materialId));
+	return material ? material->GetReadPrimvars() : nullptr;
+}
+
 void HdNSIMaterialAssign::assignFacesets(
 	const HdGeomSubsets &subset_group,
 	NSI::Context& nsi,
@@ -5,6 +5,7 @@
 
 #include <nsi.hpp>
 
+#include <memory>
 #include <string>
 
 PXR_NAMESPACE_OPEN_SCOPE
@@ -27,6 +28,12 @@ public:
 
 	const SdfPath& GetMaterialId() const { return m_materialId; }
 
+	std::shared_ptr<const TfToken::Set> ReadPrimvars(
+		HdSceneDelegate *sceneDelegate,
+		HdNSIRenderParam *renderParam,
+		HdDirtyBits dirtyBits,
+		const SdfPath &primId) const;
+
 	void assignFacesets(
 		const HdGeomSubsets &subset_broup,
 		NSI::Context& nsi,
@@ -26,9 +26,13 @@
 
 #include "mesh.h"
 
+#include "asyncNormals.h"
+#include "frameReport.h"
+#include "geometryCache.h"
 #include "renderDelegate.h"
 #include "renderParam.h"
 #include "renderPass.h"
+#include "sharedShapes.h"
 
 #include <pxr/imaging/hd/meshUtil.h>
 #include <pxr/imaging/hd/smoothNormals.h>
@@ -54,7 +58,17 @@ HdNSIMesh::HdNSIMesh(
 void
 HdNSIMesh::Finalize(HdRenderParam *renderParam)
 {
-	HdNSIRprimBase::Finalize(static_cast<HdNSIRenderParam*>(renderParam));
+	auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
+	if (auto async = nsiRenderParam->GetRenderDelegate()->GetAsyncNormals())
+	{
+		async->Cancel(Shape());
+	}
+	if (IsShapeShared())
+	{
+		nsiRenderParam->GetRenderDelegate()->GetSharedShapes()->Release(
+			nsiRenderParam, Shape());
+	}
+	HdNSIRprimBase::Finalize(nsiRenderParam);
 }
 
 HdDirtyBits
@@ -82,9 +96,42 @@ HdNSIMesh::GetInitialDirtyBitsMask() const
 	return (HdDirtyBits)mask;
 }
 
+const HdDirtyBits HdNSIMesh::_geometryBits =
+	HdChangeTracker::DirtyPoints |
+	HdChangeTracker::DirtyTopology |
+	HdChangeTracker::DirtyPrimvar |
+	HdChangeTracker::DirtyNormals |
+	HdChangeTracker::DirtySubdivTags;
+
 HdDirtyBits
 HdNSIMesh::_PropagateDirtyBits(HdDirtyBits bits) const
 {
+	/* A new material may read primvars which were not exported. */
+	if (_primvars.HasFilter() &&
+		0 != (bits & HdChangeTracker::DirtyMaterialId))
+	{
+		bits |= HdChangeTracker::DirtyPrimvar;
+	}
+	/*
+		Any change to the geometry needs the topology and points, which were
+		released. Pull them again.
+	*/
+	if (_released && 0 != (bits & (
+		HdChangeTracker::DirtyPoints |
+		HdChangeTracker::DirtyTopology |
+		HdChangeTracker::DirtyPrimvar |
+		HdChangeTracker::DirtyNormals)))
+	{
+		bits |= HdChangeTracker::DirtyPoints | HdChangeTracker::DirtyTopology;
+	}
+	/*
+		An edit of a shared shape makes it a shape of its own, which needs
+		everything exported to it.
+	*/
+	if (IsShapeShared() && 0 != (bits & _geometryBits))
+	{
+		bits |= _geometryBits;
+	}
 	return bits;
 }
 
@@ -123,6 +170,9 @@ void HdNSIMesh::Sync(
 	// Pull top-level NSI state out of the render param.
 	auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
 	NSI::Context &nsi = nsiRenderParam->AcquireSceneForEdit();
+	HdNSIFrameReport::SyncTimer timer(
+		nsiRenderParam->GetRenderDelegate()->GetFrameReport(),
+		HdNSIFrameReport::k_mesh);
 
 	/* The base rprim class tracks this but does not update it itself. */
 	if (HdChangeTracker::IsVisibilityDirty(*dirtyBits, GetId()))
@@ -157,6 +207,16 @@ void HdNSIMesh::_PopulateRtMesh(
 		*dirtyBits, id, HdTokens->points);
 	bool dirty_topology = HdChangeTracker::IsTopologyDirty(*dirtyBits, id);
 
+	/*
+		A mesh whose geometry is edited after its first sync is likely
+		animated. In lean mode, it then keeps its data instead of fetching it
+		again on every frame.
+	*/
+	if (!_firstSync && 0 != (*dirtyBits & _geometryBits))
+	{
+		_edited = true;
+	}
+
 	if (dirty_topology)
 	{
 		/*
@@ -166,9 +226,143 @@ void HdNSIMesh::_PopulateRtMesh(
 			bits. So the value we get here with topology should not be used.
 		*/
 		_topology = GetMeshTopology(sceneDelegate);
+		_faceVertexIndices = _topology.GetFaceVertexIndices();
+		/* The points come with it, see _PropagateDirtyBits(). */
+		if (_released)
+		{
+			renderParam->GetRenderDelegate()->MemoryRefetched(_releasedBytes);
+		}
+		_released = false;
+	}
 
+	////////////////////////////////////////////////////////////////////////
+	// 2. Resolve drawstyles
+
+	// The repr defines whether we should compute smooth normals for this mesh:
+	// per-vertex normals taken as an average of adjacent faces, and
+	// interpolated smoothly across faces.
+	// A released topology has no scheme. Keep what it gave.
+	if (!_released)
+	{
+		_smoothNormals = !desc.flatShadingEnabled;
+
+		/* No smooth normals with "none" or "bilinear", like hdStorm. */
+		_smoothNormals = _smoothNormals &&
+			(_topology.GetScheme() != PxOsdOpenSubdivTokens->none) &&
+			(_topology.GetScheme() != PxOsdOpenSubdivTokens->bilinear);
+		/* Don't compute smooth normals on a subdiv. They are implicitly
+		   smooth. */
+		_smoothNormals = _smoothNormals &&
+			_topology.GetScheme() != PxOsdOpenSubdivTokens->catmullClark;
+	}
+
+	HdNSIRenderDelegate *delegate = renderParam->GetRenderDelegate();
+	HdNSISharedShapes *shared = delegate->GetSharedShapes();
+
+	/* An edited shared shape goes back to one of its own. */
+	if (IsShapeShared() && 0 != (*dirtyBits & _geometryBits))
+	{
+		shared->Release(renderParam, Shape());
+		UnshareShape(nsi);
+		_primvars.ForgetExported();
+		_topologyHash = 0;
+		_normalsExported = false;
+	}
+
+	/*
+		Only export the primvars which the material reads. Geometry subsets
+		have materials of their own so they get all of them.
+	*/
+	if (HdChangeTracker::IsAnyPrimvarDirty(*dirtyBits, id))
+	{
+		_primvars.SetFilter(_topology.GetGeomSubsets().empty()
+			? _material.ReadPrimvars(sceneDelegate, renderParam, *dirtyBits, id)
+			: nullptr);
+	}
+
+	/*
+		A new mesh may share the geometry node of an identical one, be loaded
+		from the geometry cache, or be written to it. Only the first sync is
+		considered as later ones are edits. Meshes with geometry subsets are
+		not shared as their materials are assigned on the geometry node.
+	*/
+	bool first = _firstSync && dirty_topology && dirty_points;
+	_firstSync = false;
+	if (!first || !_topology.GetGeomSubsets().empty())
+	{
+		shared = nullptr;
+	}
+	HdNSIGeometryCache *cache = first ? delegate->GetGeometryCache() : nullptr;
+	std::unique_ptr<HdNSIGeometryCache::Archive> archive;
+	bool from_cache = false;
+	size_t content = 0;
+	if (shared || cache)
+	{
+		content = _primvars.Prefetch(sceneDelegate, *dirtyBits, id);
+	}
+	if (content != 0)
+	{
+		/* Everything else which goes into the geometry node. */
+		auto geometry_key = [&](size_t key)
+		{
+			key = HdNSIGeometryCache::Combine(
+				key, HdNSIGeometryCache::Hash(_topology));
+			key = HdNSIGeometryCache::Combine(key, _smoothNormals);
+			if (HdChangeTracker::IsSubdivTagsDirty(*dirtyBits, id))
+			{
+				key = HdNSIGeometryCache::Combine(key,
+					HdNSIGeometryCache::Hash(sceneDelegate->GetSubdivTags(id)));
+			}
+			return key;
+		};
+
+		if (shared)
+		{
+			/* Another user of the node exports its content. */
+			bool created;
+			ShareShape(nsi,
+				shared->Acquire(nsi, geometry_key(content), "mesh", &created));
+			from_cache = !created;
+		}
+		else
+		{
+			size_t key = geometry_key(
+				HdNSIGeometryCache::Hash(id.GetString(), content));
+			from_cache = cache->Load(nsi, key);
+			if (!from_cache)
+			{
+				archive = cache->BeginArchive(key);
+			}
+		}
+	}
+
+	/* Where the geometry's own attributes go. */
+	NSI::Context &geo = archive ? archive->Context() : nsi;
+
+	/*
+		Hydra often dirties the topology when it did not change (eg. a
+		recook). Only send it, and update what depends on it, if it did.
+	*/
+	bool topology_changed = false;
+	if (dirty_topology)
+	{
+		size_t hash = _topology.ComputeHash();
+		topology_changed = hash != _topologyHash;
+		_topologyHash = hash;
+
+		auto report = renderParam->GetRenderDelegate()->GetFrameReport();
+		if (report && !topology_changed)
+		{
+			report->Add(HdNSIFrameReport::k_skipped_bytes,
+				_topology.GetFaceVertexCounts().size() * sizeof(int));
+		}
+	}
+
+	if (topology_changed && !from_cache)
+	{
 		VtIntArray faceVertexCounts = _topology.GetFaceVertexCounts();
-		_faceVertexIndices = _topology.GetFaceVertexIndices();
+		if (auto report = renderParam->GetRenderDelegate()->GetFrameReport())
+			report->Add(HdNSIFrameReport::k_faces, faceVertexCounts.size());
 
 		NSI::ArgumentList attrs;
 
@@ -191,10 +385,10 @@ void HdNSIMesh::_PopulateRtMesh(
 		/* Make creases as ugly as everyone else. */
 		attrs.push(new NSI::IntegerArg("subdivision.smoothcreasecorners", 0));
 
-		nsi.SetAttribute(Shape(), attrs);
+		geo.SetAttribute(Shape(), attrs);
 	}
 
-	if (HdChangeTracker::IsSubdivTagsDirty(*dirtyBits, id))
+	if (HdChangeTracker::IsSubdivTagsDirty(*dirtyBits, id) && !from_cache)
 	{
 		NSI::ArgumentList attrs;
 		PxOsdSubdivTags subdivTags = sceneDelegate->GetSubdivTags(id);
@@ -229,38 +423,30 @@ void HdNSIMesh::_PopulateRtMesh(
 
 		if (!attrs.empty())
 		{
-			nsi.SetAttribute(Shape(), attrs);
+			geo.SetAttribute(Shape(), attrs);
 		}
 	}
 
-	////////////////////////////////////////////////////////////////////////
-	// 2. Resolve drawstyles
-
-	// The repr defines whether we should compute smooth normals for this mesh:
-	// per-vertex normals taken as an average of adjacent faces, and
-	// interpolated smoothly across faces.
-	_smoothNormals = !desc.flatShadingEnabled;
-
-	/* No smooth normals with "none" or "bilinear", like hdStorm. */
-	_smoothNormals = _smoothNormals &&
-		(_topology.GetScheme() != PxOsdOpenSubdivTokens->none) &&
-		(_topology.GetScheme() != PxOsdOpenSubdivTokens->bilinear);
-	/* Don't compute smooth normals on a subdiv. They are implicitly smooth. */
-	_smoothNormals = _smoothNormals &&
-		_topology.GetScheme() != PxOsdOpenSubdivTokens->catmullClark;
-
 
 	_material.Sync(
-		sceneDelegate, renderParam, dirtyBits, nsi, GetId(), Shape());
+		sceneDelegate, renderParam, dirtyBits, nsi, GetId(),
+		AttributesTarget());
 
 	if (dirty_topology)
 	{
 		_material.assignFacesets(_topology.GetGeomSubsets(), nsi, Shape());
 	}
 
-	_primvars.Sync(
-		sceneDelegate, renderParam, dirtyBits, nsi, GetId(),
-		Shape(), _faceVertexIndices);
+	if (from_cache)
+	{
+		_primvars.SkipSync(dirtyBits);
+	}
+	else
+	{
+		_primvars.Sync(
+			sceneDelegate, renderParam, dirtyBits, geo, GetId(),
+			Shape(), _faceVertexIndices);
+	}
 
 	/*
 		Update the generated smooth normals, if required. If there are no
@@ -270,34 +456,110 @@ void HdNSIMesh::_PopulateRtMesh(
 	if (!_primvars.HasNormals() && _smoothNormals)
 	{
 		/*
-			If the topology is dirty, update the adjacency table, a processed
-			form of the topology that helps calculate smooth normals quickly.
+			If the points, or the topology above, actually changed, update
+			the smooth normals. The geometry cache has them already.
 		*/
-		if (dirty_topology)
+		if( from_cache )
 		{
-			_adjacency.BuildAdjacencyTable(&_topology);
+			_normalsExported = true;
 		}
-		/*
-			If the points are dirty, or the topology above changed, update the
-			smooth normals.
-		*/
-		if( dirty_topology || dirty_points )
+		else if( topology_changed || _primvars.PointsChanged() ||
+		         !_normalsExported )
 		{
+			/*
+				Normals of the same topology may be computed in the
+				background while the render uses the previous ones.
+			*/
+			HdNSIAsyncNormals *async =
+				renderParam->GetRenderDelegate()->GetAsyncNormals();
+			bool background = async && _normalsExported &&
+				!topology_changed && &geo == &nsi;
+			if (async && !background)
+			{
+				/* Don't let older normals replace these. */
+				async->Cancel(Shape());
+			}
+			_normalsExported = true;
+			/*
+				Update the adjacency table, a processed form of the topology
+				that helps calculate smooth normals quickly.
+			*/
+			if (topology_changed || _adjacency.GetAdjacencyTable().empty())
+			{
+				_adjacency.BuildAdjacencyTable(&_topology);
+			}
 			const VtVec3fArray &points = _primvars.GetPoints();
-			VtVec3fArray normals = Hd_SmoothNormals::ComputeSmoothNormals(
-				&_adjacency, points.size(), points.cdata());
-
-			nsi.SetAttribute(Shape(), (
-				*NSI::Argument("N")
-					.SetType(NSITypeNormal)
-					->SetCount(normals.size())
-					->SetValuePointer(normals.cdata()),
-				*NSI::Argument("N.indices")
-					.SetType(NSITypeInteger)
-					->SetCount(_faceVertexIndices.size())
-					->SetValuePointer(_faceVertexIndices.cdata())));
+			if (background)
+			{
+				async->Submit(Shape(), _adjacency, points, _faceVertexIndices);
+			}
+			else
+			{
+				VtVec3fArray normals = Hd_SmoothNormals::ComputeSmoothNormals(
+					&_adjacency, points.size(), points.cdata());
+
+				/* Huge normals are sent right away, like huge primvars. */
+				auto buffer = renderParam->GetCommandBuffer(geo);
+				if (normals.size() * sizeof(GfVec3f) >=
+				    HdNSIPrimvars::k_stream_bytes)
+				{
+					buffer = nullptr;
+				}
+				if (buffer)
+				{
+					buffer->SetAttribute(Shape(),
+						HdPrimvarDescriptor(HdTokens->normals,
+							HdInterpolationVertex, HdPrimvarRoleTokens->normal),
+						VtValue(normals), 0, 0.0, false);
+					buffer->SetIntArray(Shape(), "N.indices", _faceVertexIndices);
+				}
+				else
+				{
+					geo.SetAttribute(Shape(), (
+						*NSI::Argument("N")
+							.SetType(NSITypeNormal)
+							->SetCount(normals.size())
+							->SetValuePointer(normals.cdata()),
+						*NSI::Argument("N.indices")
+							.SetType(NSITypeInteger)
+							->SetCount(_faceVertexIndices.size())
+							->SetValuePointer(_faceVertexIndices.cdata())));
+				}
+			}
 		}
 	}
+	else
+	{
+		_normalsExported = false;
+		if (auto async = renderParam->GetRenderDelegate()->GetAsyncNormals())
+		{
+			async->Cancel(Shape());
+		}
+	}
+
+	if (archive)
+	{
+		cache->EndArchive(std::move(archive), nsi);
+	}
+
+	/*
+		3Delight has its own copy of everything now. Unless the mesh is edited
+		again, which then fetches everything again, ours is no longer needed.
+		An edited mesh keeps it, see above.
+	*/
+	if (renderParam->GetRenderDelegate()->IsLeanBatch() && !_edited)
+	{
+		size_t released = _primvars.ReleasePoints();
+		released += _faceVertexIndices.size() * sizeof(int);
+		released += _topology.GetFaceVertexCounts().size() * sizeof(int);
+		released += _adjacency.GetAdjacencyTable().size() * sizeof(int);
+		_topology = HdMeshTopology();
+		_faceVertexIndices = VtIntArray();
+		_adjacency = Hd_VertexAdjacency();
+		_released = true;
+		_releasedBytes = released;
+		renderParam->GetRenderDelegate()->MemoryReleased(released);
+	}
 
 	// Clean all dirty bits.
 	*dirtyBits &= ~HdChangeTracker::AllSceneDirtyBits;
@@ -172,6 +172,20 @@ private:
 
     Hd_VertexAdjacency _adjacency;
     bool _smoothNormals;
+    // Only the first sync may use the geometry cache.
+    bool _firstSync{true};
+    // The cached data above was released after export, in lean batch mode.
+    bool _released{false};
+    // Size of what was released, reported when it is fetched again.
+    size_t _releasedBytes{0};
+    // The geometry was edited after the first sync. It is not released.
+    bool _edited{false};
+    // Hash of the exported topology, to skip sending it again unchanged.
+    size_t _topologyHash{0};
+    // Smooth normals were generated and exported.
+    bool _normalsExported{false};
+    // Geometry bits which make a shared shape go back to one of its own.
+    static const HdDirtyBits _geometryBits;
 
     HdNSIMaterialAssign _material;
     HdNSIPrimvars _primvars{true};
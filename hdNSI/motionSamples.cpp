@@ -0,0 +1,298 @@
+#include "motionSamples.h"
+
+#include <pxr/base/gf/math.h>
+#include <pxr/base/gf/quatd.h>
+
+#include <algorithm>
+#include <cmath>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace
+{
+/* Rotation between two transform samples above which one is added. */
+const double k_max_rotation = GfDegreesToRadians(20.0);
+
+/*
+	Replace the samples outside the shutter by one at its edge. A value in
+	the shutter is kept as is.
+*/
+template <typename T>
+void ClipSamples(HdTimeSampleArray<T, 4> &samples, const GfRange1d &shutter)
+{
+	if (shutter.IsEmpty() || samples.count < 2)
+		return;
+
+	float open = shutter.GetMin();
+	float close = shutter.GetMax();
+	float first = samples.times[0];
+	float last = samples.times[samples.count - 1];
+	if (first >= open && last <= close)
+		return;
+
+	TfSmallVector<float, 4> times;
+	TfSmallVector<T, 4> values;
+	auto in = [&](float t) { return t >= open && t <= close; };
+	if (first < open &&
+	    std::find(samples.times.begin(), samples.times.end(), open) ==
+	    samples.times.end())
+	{
+		times.push_back(open);
+		values.push_back(samples.Resample(open));
+	}
+	for (size_t i = 0; i < samples.count; ++i)
+	{
+		if (in(samples.times[i]))
+		{
+			times.push_back(samples.times[i]);
+			values.push_back(samples.values[i]);
+		}
+	}
+	if (last > close && (times.empty() || times.back() != close))
+	{
+		times.push_back(close);
+		values.push_back(samples.Resample(close));
+	}
+
+	samples.Resize(times.size());
+	for (size_t i = 0; i < times.size(); ++i)
+	{
+		samples.times[i] = times[i];
+		samples.values[i] = values[i];
+	}
+}
+
+/*
+	Drop the samples which the renderer would interpolate from their
+	neighbours, as told by predictable(previous, sample, next, alpha).
+*/
+template <typename T, typename F>
+void DropRedundant(HdTimeSampleArray<T, 4> &samples, F predictable)
+{
+	if (samples.count < 2)
+		return;
+
+	size_t kept = 1;
+	for (size_t i = 1; i + 1 < samples.count; ++i)
+	{
+		float t0 = samples.times[kept - 1];
+		float t2 = samples.times[i + 1];
+		float alpha = (samples.times[i] - t0) / (t2 - t0);
+		if (predictable(
+			samples.values[kept - 1], samples.values[i],
+			samples.values[i + 1], alpha))
+		{
+			continue;
+		}
+		samples.times[kept] = samples.times[i];
+		samples.values[kept] = samples.values[i];
+		++kept;
+	}
+	samples.times[kept] = samples.times[samples.count - 1];
+	samples.values[kept] = samples.values[samples.count - 1];
+	++kept;
+
+	/* Two equal samples are no motion at all. */
+	if (kept == 2 && samples.values[0] == samples.values[1])
+	{
+		kept = 1;
+	}
+	samples.Resize(kept);
+}
+
+bool IsClose(const GfMatrix4d &a, const GfMatrix4d &b)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			double tolerance = 1e-9 * std::max(1.0, std::abs(b[i][j]));
+			if (!GfIsClose(a[i][j], b[i][j], tolerance))
+				return false;
+		}
+	}
+	return true;
+}
+
+/* A transform split so its rotation can be interpolated. */
+struct Parts
+{
+	GfMatrix4d scale;
+	GfQuatd rotation;
+	GfVec3d translation;
+
+	explicit Parts(const GfMatrix4d &m)
+	{
+		GfMatrix4d rt = m.RemoveScaleShear();
+		scale = m * rt.GetInverse();
+		rotation = rt.ExtractRotationQuat();
+		translation = rt.ExtractTranslation();
+	}
+};
+
+double RotationAngle(const GfMatrix4d &a, const GfMatrix4d &b)
+{
+	double d = std::abs(GfDot(Parts(a).rotation, Parts(b).rotation));
+	return 2.0 * std::acos(std::min(1.0, d));
+}
+
+GfMatrix4d Interpolate(const GfMatrix4d &a, const GfMatrix4d &b, double alpha)
+{
+	Parts pa(a), pb(b);
+	if (GfDot(pa.rotation, pb.rotation) < 0.0)
+		pb.rotation *= -1.0;
+
+	GfMatrix4d r;
+	r.SetRotate(GfSlerp(alpha, pa.rotation, pb.rotation));
+	r.SetTranslateOnly(GfLerp(alpha, pa.translation, pb.translation));
+	return (pa.scale * (1.0 - alpha) + pb.scale * alpha) * r;
+}
+}
+
+/**
+	\brief Set the shutter of a camera.
+
+	\returns
+		true if the range covering all shutters changed. Exported samples may
+		then be missing some of it.
+*/
+bool HdNSIMotionSamples::SetCameraShutter(
+	const SdfPath &camera,
+	const GfRange1d &shutter)
+{
+	auto it = m_cameras.find(camera);
+	if (it != m_cameras.end() && it->second == shutter)
+		return false;
+
+	m_cameras[camera] = shutter;
+	GfRange1d previous = m_shutter;
+	UpdateShutter();
+	return m_shutter != previous;
+}
+
+/**
+	\brief Forget the shutter of a removed camera.
+
+	\returns
+		true if the range covering all shutters changed.
+*/
+bool HdNSIMotionSamples::RemoveCamera(const SdfPath &camera)
+{
+	if (m_cameras.erase(camera) == 0)
+		return false;
+
+	GfRange1d previous = m_shutter;
+	UpdateShutter();
+	return m_shutter != previous;
+}
+
+void HdNSIMotionSamples::UpdateShutter()
+{
+	m_shutter = GfRange1d();
+	for (const auto &camera : m_cameras)
+	{
+		if (!camera.second.IsEmpty())
+			m_shutter.UnionWith(camera.second);
+	}
+}
+
+/**
+	\brief Clip transform samples to the shutter and drop redundant ones.
+
+	Samples which are equal to, or linear interpolations of, their neighbours
+	are dropped. As a rotation is not linear, those samples are kept.
+*/
+void HdNSIMotionSamples::ReduceTransform(
+	HdTimeSampleArray<GfMatrix4d, 4> &samples) const
+{
+	ClipSamples(samples, m_shutter);
+	AddRotationSamples(samples);
+	DropRedundant(samples,
+		[](const GfMatrix4d &a, const GfMatrix4d &b, const GfMatrix4d &c,
+		   float alpha)
+		{
+			return IsClose(a * (1.0 - alpha) + c * alpha, b);
+		});
+}
+
+/**
+	\brief Clip primvar samples to the shutter and drop redundant ones.
+
+	Only samples equal to both their neighbours are dropped here. Comparing
+	interpolated arrays would cost more than exporting them.
+*/
+void HdNSIMotionSamples::ReducePrimvar(
+	HdTimeSampleArray<VtValue, 4> &samples) const
+{
+	ClipSamples(samples, m_shutter);
+	DropRedundant(samples,
+		[](const VtValue &a, const VtValue &b, const VtValue &c, float)
+		{
+			return b == a && b == c;
+		});
+}
+
+/**
+	\brief Clip a sorted list of sample times to the shutter.
+
+	Times outside it are replaced by its edge.
+*/
+void HdNSIMotionSamples::ClipTimes(TfSmallVector<float, 10> &times) const
+{
+	if (m_shutter.IsEmpty() || times.size() < 2)
+		return;
+
+	float open = m_shutter.GetMin();
+	float close = m_shutter.GetMax();
+	bool before = times.front() < open;
+	bool after = times.back() > close;
+	times.erase(
+		std::remove_if(times.begin(), times.end(),
+			[&](float t) { return t < open || t > close; }),
+		times.end());
+	if (before)
+		times.insert(times.begin(), open);
+	if (after)
+		times.push_back(close);
+	times.erase(std::unique(times.begin(), times.end()), times.end());
+}
+
+/*
+	The renderer interpolates matrices, which shrinks objects that rotate
+	fast between samples. Split the largest rotations while allowed.
+*/
+void HdNSIMotionSamples::AddRotationSamples(
+	HdTimeSampleArray<GfMatrix4d, 4> &samples) const
+{
+	while (samples.count >= 2 && samples.count < m_max_transform_samples)
+	{
+		size_t largest = 0;
+		double angle = 0.0;
+		for (size_t i = 0; i + 1 < samples.count; ++i)
+		{
+			double a = RotationAngle(samples.values[i], samples.values[i + 1]);
+			if (a > angle)
+			{
+				angle = a;
+				largest = i;
+			}
+		}
+		if (angle <= k_max_rotation)
+			return;
+
+		size_t count = samples.count;
+		samples.Resize(count + 1);
+		for (size_t i = count; i > largest + 1; --i)
+		{
+			samples.times[i] = samples.times[i - 1];
+			samples.values[i] = samples.values[i - 1];
+		}
+		samples.times[largest + 1] = 0.5f *
+			(samples.times[largest] + samples.times[largest + 2]);
+		samples.values[largest + 1] = Interpolate(
+			samples.values[largest], samples.values[largest + 2], 0.5);
+	}
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
@@ -0,0 +1,56 @@
+#ifndef HDNSI_MOTIONSAMPLES_H
+#define HDNSI_MOTIONSAMPLES_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/range1d.h>
+#include <pxr/base/tf/smallVector.h>
+#include <pxr/base/vt/value.h>
+#include <pxr/imaging/hd/timeSampleArray.h>
+#include <pxr/usd/sdf/path.h>
+
+#include <map>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/*
+	Prepares the motion samples of transforms and primvars for export.
+
+	Samples outside the shutter of every camera are replaced by the value at
+	the shutter's edge and samples which the renderer would interpolate anyway
+	are dropped. Transforms with fast rotation may also get extra samples, as
+	the renderer interpolates the matrices between them.
+
+	The shutters are updated by the cameras, which are synced before the
+	lights and the rprims. Those only read them, in parallel. Interpolated
+	rotation samples are an approximation: they are spherical blends of the
+	samples around them, not samples of the scene.
+*/
+class HdNSIMotionSamples
+{
+public:
+	bool SetCameraShutter(const SdfPath &camera, const GfRange1d &shutter);
+	bool RemoveCamera(const SdfPath &camera);
+	/* The range which covers the shutters of all cameras. */
+	const GfRange1d& GetShutter() const { return m_shutter; }
+
+	/* 0 to never add samples. */
+	void SetMaxTransformSamples(unsigned n) { m_max_transform_samples = n; }
+
+	void ReduceTransform(HdTimeSampleArray<GfMatrix4d, 4> &samples) const;
+	void ReducePrimvar(HdTimeSampleArray<VtValue, 4> &samples) const;
+	void ClipTimes(TfSmallVector<float, 10> &times) const;
+
+private:
+	void UpdateShutter();
+	void AddRotationSamples(HdTimeSampleArray<GfMatrix4d, 4> &samples) const;
+
+	std::map<SdfPath, GfRange1d> m_cameras;
+	GfRange1d m_shutter;
+	unsigned m_max_transform_samples{0};
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
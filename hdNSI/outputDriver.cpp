@@ -1,8 +1,15 @@
 #include "outputDriver.h"
 
 #include <cassert>
+#include <chrono>
 #include <limits>
 
+namespace
+{
+/* Time spent storing pixels, in nanoseconds, for the frame report. */
+std::atomic<uint64_t> s_write_ns{0};
+}
+
 void HdNSIOutputDriver::Register(NSI::DynamicAPI &api)
 {
 	// Retrieve the function pointer to register display driver.
@@ -44,9 +51,9 @@ PtDspyError HdNSIOutputDriver::ImageOpen(
 		return PkDspyErrorBadParams;
 	}
 
-	// Find the pointer to preallocated renderBuffer
+	// Find the slot holding the preallocated renderBuffer
 	using PXR_INTERNAL_NS::HdNSIRenderBuffer;
-	HdNSIRenderBuffer *buffer = nullptr;
+	BufferSlot *slot = nullptr;
 
 	for (int i = 0; i < paramCount; ++i)
 	{
@@ -54,10 +61,11 @@ PtDspyError HdNSIOutputDriver::ImageOpen(
 
 		const std::string param_name = parameter->name;
 		if (param_name == "buffer") {
-			buffer = ((HdNSIRenderBuffer**)parameter->value)[0];
+			slot = ((BufferSlot**)parameter->value)[0];
 		}
 	}
 
+	HdNSIRenderBuffer *buffer = slot ? slot->load() : nullptr;
 	if (buffer == nullptr)
 	{
 		return PkDspyErrorBadParams;
@@ -74,7 +82,11 @@ PtDspyError HdNSIOutputDriver::ImageOpen(
 	// Initialize the image handle.
 	imageHandle->_width = width;
 	imageHandle->_height = height;
-	imageHandle->m_buffer = buffer;
+	imageHandle->_originalSizeX = width;
+	imageHandle->_originalSizeY = height;
+	imageHandle->_originX = 0;
+	imageHandle->_originY = 0;
+	imageHandle->m_slot = slot;
 
 	for(int i = 0;i < paramCount; ++ i)
 	{
@@ -172,23 +184,62 @@ PtDspyError HdNSIOutputDriver::ImageData(
 		return PkDspyErrorStop;
 	}
 
-	assert(entrySize == HdDataSizeOfFormat(imageHandle->m_buffer->GetFormat()));
-	auto bufferFormat = imageHandle->m_buffer->GetFormat();
+	/*
+		The render pass may have detached this output or moved it to another
+		buffer since it was opened. Drop data which no longer fits anywhere.
+	*/
+	PXR_INTERNAL_NS::HdNSIRenderBuffer *target = imageHandle->m_slot->load();
+	if (!target ||
+	    int(target->GetWidth()) != imageHandle->_originalSizeX ||
+	    int(target->GetHeight()) != imageHandle->_originalSizeY ||
+	    entrySize != int(HdDataSizeOfFormat(target->GetFormat())))
+	{
+		return PkDspyErrorNone;
+	}
+
+	/* A cropped image (eg. resumed from a checkpoint) is placed by origin. */
+	WriteRegion(
+		target, imageHandle->m_project,
+		xMin + imageHandle->_originX, xMaxPlusOne + imageHandle->_originX,
+		yMin + imageHandle->_originY, yMaxPlusOne + imageHandle->_originY,
+		entrySize, cdata);
+
+    return PkDspyErrorNone;
+}
+
+/*
+	Store a block of pixels, as the renderer produces them, into a render
+	buffer. The coordinates are in the full image, with row 0 at the top.
+	This is also used to merge images rendered by other processes.
+*/
+void HdNSIOutputDriver::WriteRegion(
+	PXR_INTERNAL_NS::HdNSIRenderBuffer *target,
+	const ProjData *project,
+	int xMin, int xMaxPlusOne,
+	int yMin, int yMaxPlusOne,
+	int entrySize,
+	const unsigned char *cdata)
+{
+	auto start = std::chrono::steady_clock::now();
+	const int fullWidth = int(target->GetWidth());
+	const int fullHeight = int(target->GetHeight());
+
+	auto bufferFormat = target->GetFormat();
 	bool intConvert = PXR_INTERNAL_NS::HdFormatInt32 ==
 		HdGetComponentFormat(bufferFormat);
-	uint8_t *buffer = (uint8_t *)imageHandle->m_buffer->Map();
+	uint8_t *buffer = (uint8_t *)target->Map();
 
 	for (int y = yMin; y < yMaxPlusOne; ++ y)
 	{
 		/* Hydra works with row 0 at the bottom. */
-		int buffer_y = imageHandle->_height - y - 1;
+		int buffer_y = fullHeight - y - 1;
 		uint8_t *buf_out =
-			buffer + entrySize * (buffer_y * imageHandle->_width + xMin);
+			buffer + entrySize * (buffer_y * fullWidth + xMin);
 		const uint8_t *buf_in =
 			cdata + entrySize * (y - yMin) * (xMaxPlusOne - xMin);
-		if (imageHandle->m_project)
+		if (project)
 		{
-			const auto &pd = *imageHandle->m_project;
+			const auto &pd = *project;
 			/* Hydra expects a post-projection depth, which is nonlinear in
 			   [-1, 1], remapped to [0,1] */
 			for (int x = xMin; x < xMaxPlusOne; ++x)
@@ -218,10 +269,20 @@ PtDspyError HdNSIOutputDriver::ImageData(
 		{
 			memcpy(buf_out, buf_in, entrySize * (xMaxPlusOne - xMin));
 		}
+		target->AddRowPixels(y, xMaxPlusOne - xMin);
 	}
-	imageHandle->m_buffer->Unmap();
+	target->Unmap();
 
-    return PkDspyErrorNone;
+	s_write_ns.fetch_add(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count(),
+		std::memory_order_relaxed);
+}
+
+/* Total time spent in WriteRegion(), in seconds, by all buffers. */
+double HdNSIOutputDriver::WriteTime()
+{
+	return s_write_ns.load(std::memory_order_relaxed) * 1e-9;
 }
 
 PtDspyError HdNSIOutputDriver::ImageClose(PtDspyImageHandle hImage)
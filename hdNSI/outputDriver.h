@@ -6,6 +6,8 @@
 #include <ndspy.h>
 #include <nsi_dynamic.hpp>
 
+#include <atomic>
+
 class HdNSIOutputDriver
 {
 public:
@@ -18,6 +20,13 @@ public:
 		double M22{-0.5}, M32{0.0};
 	};
 
+	/*
+		Indirection through which the driver finds its render buffer. This
+		lets the render pass retarget an output layer to another buffer, or
+		detach it, without reopening the image.
+	*/
+	typedef std::atomic<PXR_INTERNAL_NS::HdNSIRenderBuffer*> BufferSlot;
+
 	class Handle
 	{
 	public:
@@ -28,11 +37,21 @@ public:
 		/* Given only to the display which handles depth. */
 		ProjData *m_project{nullptr};
 
-		PXR_INTERNAL_NS::HdNSIRenderBuffer *m_buffer;
+		BufferSlot *m_slot;
 	};
 
 	static void Register(NSI::DynamicAPI &api);
 
+	static void WriteRegion(
+		PXR_INTERNAL_NS::HdNSIRenderBuffer *target,
+		const ProjData *project,
+		int xMin, int xMaxPlusOne,
+		int yMin, int yMaxPlusOne,
+		int entrySize,
+		const unsigned char *cdata);
+
+	static double WriteTime();
+
 private:
 	// Display Driver - Open callback function.
 	static PtDspyError ImageOpen(
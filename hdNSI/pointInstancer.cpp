@@ -1,5 +1,7 @@
 #include "pointInstancer.h"
 
+#include "frameReport.h"
+#include "renderDelegate.h"
 #include "renderParam.h"
 #include "rprimBase.h"
 
@@ -67,12 +69,11 @@ void HdNSIPointInstancer::Finalize(
 #endif
 	if (!m_instancerHandle.empty())
 	{
-		NSI::Context &nsi = nsiRenderParam->AcquireSceneForEdit();
-		nsi.Delete(m_instancerHandle);
-		nsi.Delete(m_xformHandle);
+		nsiRenderParam->DeleteNode(m_instancerHandle);
+		nsiRenderParam->DeleteNode(m_xformHandle);
 		for( int i = 0; i < m_model_count; ++i )
 		{
-			nsi.Delete(ModelHandle(i));
+			nsiRenderParam->DeleteNode(ModelHandle(i));
 		}
 		m_instancerHandle.clear();
 		m_xformHandle.clear();
@@ -101,6 +102,9 @@ void HdNSIPointInstancer::SyncPrototype(
 	const SdfPath &id = GetId();
 
 	NSI::Context &nsi = renderParam->AcquireSceneForEdit();
+	HdNSIFrameReport::SyncTimer timer(
+		renderParam->GetRenderDelegate()->GetFrameReport(),
+		HdNSIFrameReport::k_instancer);
 	HdDirtyBits dirtyBits = changeTracker.GetInstancerDirtyBits(id);
 
 	if (m_instancerHandle.empty())
@@ -185,6 +189,11 @@ void HdNSIPointInstancer::SyncPrototype(
 		multiple permutations of the available prototypes.
 	*/
 	bool write_modelindices = false;
+	if (m_indices_released && 0 != (dirtyBits & HdChangeTracker::DirtyPrimvar))
+	{
+		/* The instance count may change. Rebuild the released indices. */
+		dirtyBits |= HdChangeTracker::DirtyInstanceIndex;
+	}
 	if (0 != (dirtyBits & HdChangeTracker::DirtyInstanceIndex))
 	{
 		/* Delete previous model nodes. */
@@ -231,6 +240,7 @@ void HdNSIPointInstancer::SyncPrototype(
 		/* Update model indices and instanceId */
 		m_model_indices.clear();
 		m_instance_id.clear();
+		m_indices_released = false;
 
 		for (size_t m = 0; m < model_instance_indices.size(); ++m)
 		{
@@ -302,9 +312,10 @@ void HdNSIPointInstancer::SyncPrototype(
 			}
 		}
 
-		/* Compute set of unique time samples. */
+		/* Compute set of unique time samples, within the shutter. */
 		std::sort(times.begin(), times.end());
 		times.erase(std::unique(times.begin(), times.end()), times.end());
+		renderParam->GetMotionSamples().ClipTimes(times);
 
 		if (times.size() > 1)
 		{
@@ -393,6 +404,9 @@ void HdNSIPointInstancer::SyncPrototype(
 
 	if (write_modelindices)
 	{
+		if (auto report = renderParam->GetRenderDelegate()->GetFrameReport())
+			report->Add(HdNSIFrameReport::k_instances, m_model_indices.size());
+
 		nsi.SetAttribute(m_instancerHandle,
 			*NSI::Argument("modelindices")
 			.SetType(NSITypeInteger)
@@ -405,13 +419,25 @@ void HdNSIPointInstancer::SyncPrototype(
 			.SetType(NSITypeInteger)
 			->SetCount(m_instance_id.size())
 			->SetValuePointer(m_instance_id.data()));
+
+		/* 3Delight has its own copy. */
+		if (renderParam->GetRenderDelegate()->IsLeanBatch())
+		{
+			size_t released = (m_model_indices.capacity() +
+				m_instance_id.capacity()) * sizeof(int);
+			std::vector<int>().swap(m_model_indices);
+			std::vector<int>().swap(m_instance_id);
+			m_indices_released = true;
+			renderParam->GetRenderDelegate()->MemoryReleased(released);
+		}
 	}
 
 	/* This handles the single instancer transform. */
 	if (0 != (dirtyBits & HdChangeTracker::DirtyTransform))
 	{
 		HdNSIRprimBase::ExportTransform(
-			GetDelegate(), id, true, nsi, m_xformHandle);
+			GetDelegate(), id, true, renderParam->GetMotionSamples(), nsi,
+			m_xformHandle);
 	}
 
 	/* Do the primvars. */
@@ -81,6 +81,8 @@ private:
 	std::vector<int> m_model_indices;
 	/* The instanceId attribute (for AOV). */
 	std::vector<int> m_instance_id;
+	/* The two arrays above were released after export. */
+	bool m_indices_released{false};
 
 	HdNSIPrimvars m_primVars;
 
@@ -1,14 +1,57 @@
 #include "primvars.h"
 
-#include <pxr/base/gf/vec2f.h>
+#include "commandBuffer.h"
+#include "frameReport.h"
+#include "geometryCache.h"
+#include "motionSamples.h"
+#include "renderDelegate.h"
+#include "renderParam.h"
+#include "valueTypes.h"
+
+#include <pxr/base/work/loops.h>
 #include <pxr/imaging/hd/extComputationUtils.h>
+#include <pxr/imaging/hd/types.h>
 
 #include <nsi_dynamic.hpp>
 
+#include <algorithm>
 #include <cassert>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
+namespace
+{
+const HdDirtyBits k_primvar_bits =
+	HdChangeTracker::DirtyPoints |
+	HdChangeTracker::DirtyPrimvar |
+	HdChangeTracker::DirtyNormals |
+	HdChangeTracker::DirtyWidths;
+
+const HdInterpolation types[] =
+{
+	HdInterpolationConstant,
+	HdInterpolationUniform,
+	HdInterpolationVarying,
+	HdInterpolationVertex,
+	HdInterpolationFaceVarying,
+	HdInterpolationInstance
+};
+
+size_t HashCombine(size_t seed, size_t value)
+{
+	return seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+/* Size of all the samples of a primvar. */
+size_t SampleBytes(const HdNSIPrimvars::SampleArray &v)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < v.count; ++i)
+		size += HdDataSizeOfTupleType(HdGetValueTupleType(v.values[i]));
+	return size;
+}
+}
+
 /**
 	FIXME: when a primvar is deleted, we don't restore the default value.
 	This can be tested easily by changing visibilkity to camera to off
@@ -23,111 +66,329 @@ void HdNSIPrimvars::Sync(
 	const std::string &geoHandle,
 	const VtIntArray &vertexIndices )
 {
-	auto primvar_bits =
-		HdChangeTracker::DirtyPoints |
-		HdChangeTracker::DirtyPrimvar |
-		HdChangeTracker::DirtyNormals |
-		HdChangeTracker::DirtyWidths;
-
-	if (0 == (*dirtyBits & primvar_bits))
+	if (0 == (*dirtyBits & k_primvar_bits))
 		return;
 
-	HdInterpolation types[] =
+	if (0 != (*dirtyBits & HdChangeTracker::DirtyNormals))
+	{
+		m_has_normals = false;
+	}
+	m_points_changed = false;
+	m_vertex_indices_hash = 0;
+
+	/* Edits are recorded, to be sent after all prims are synced. */
+	HdNSICommandBuffer *buffer = renderParam->GetCommandBuffer(nsi);
+	const HdNSIMotionSamples &motion = renderParam->GetMotionSamples();
+
+	/* Size of the exported (or skipped) data, for the frame report. */
+	HdNSIFrameReport *report = renderParam->GetRenderDelegate()->GetFrameReport();
+	size_t bytes = 0, skipped_bytes = 0, points = 0;
+	auto count_bytes = [report, &bytes, &skipped_bytes, &points](
+		const HdPrimvarDescriptor &primvar, const SampleArray &v, bool sent)
+	{
+		if (!report)
+			return;
+		size_t &total = sent ? bytes : skipped_bytes;
+		total += SampleBytes(v);
+		if (primvar.name == HdTokens->points && v.count > 0)
+			points = v.values[0].GetArraySize();
+	};
+
+	/*
+		Gather the dirty primvars first, in order, so their values can be
+		fetched in parallel. The NSI calls are then made in that same order
+		to produce the same scene every time.
+	*/
+	struct Fetch
 	{
-		HdInterpolationConstant,
-		HdInterpolationUniform,
-		HdInterpolationVarying,
-		HdInterpolationVertex,
-		HdInterpolationFaceVarying,
-		HdInterpolationInstance
+		HdPrimvarDescriptor primvar;
+		bool object{false};
+		const SampleArray *values{nullptr};
+		SampleArray fetched;
 	};
+	std::vector<Fetch> fetches;
+	std::vector<Fetch*> to_fetch;
 
-	if (0 != (*dirtyBits & HdChangeTracker::DirtyNormals))
+	UpdateDescriptors(sceneDelegate, *dirtyBits, primId);
+	for (const Descriptor &d : m_descriptors)
 	{
-		m_has_normals = false;
+		if (!d.object && IsFiltered(d.primvar.name))
+		{
+			ForgetFiltered(nsi, buffer, geoHandle, d.primvar.name);
+			continue;
+		}
+		if (!ShouldUpdateVar(*dirtyBits, primId, d.primvar.name))
+			continue;
+
+		fetches.emplace_back();
+		fetches.back().primvar = d.primvar;
+		fetches.back().object = d.object;
 	}
 
-	for (auto type : types)
+	for (Fetch &f : fetches)
 	{
-		HdPrimvarDescriptorVector primvars =
-			sceneDelegate->GetPrimvarDescriptors(primId, type);
+		/* Object attributes are read by SetObjectAttributes(). */
+		if (f.object)
+			continue;
+		f.values = FindPrefetched(f.primvar);
+		if (!f.values)
+		{
+			f.values = &f.fetched;
+			to_fetch.push_back(&f);
+		}
+	}
 
-		for (const HdPrimvarDescriptor &primvar : primvars)
+	auto sample = [sceneDelegate, &primId](Fetch *f)
+	{
+		f->fetched.Sample(sceneDelegate, primId, f->primvar.name);
+	};
+	/*
+		Huge prims are streamed instead: each primvar is fetched, sent and
+		released before the next one, so only one is held at a time. The
+		points, or else the first primvar, tell if the prim is that large.
+	*/
+	bool stream = false;
+	if (!to_fetch.empty())
+	{
+		auto first = std::find_if(to_fetch.begin(), to_fetch.end(),
+			[](const Fetch *f) { return f->primvar.name == HdTokens->points; });
+		if (first == to_fetch.end())
+			first = to_fetch.begin();
+		sample(*first);
+		stream = SampleBytes((*first)->fetched) >= k_stream_bytes;
+		to_fetch.erase(first);
+	}
+	/* Not worth the task overhead for a few. */
+	if (!stream && to_fetch.size() > 2)
+	{
+		WorkParallelForEach(to_fetch.begin(), to_fetch.end(), sample);
+	}
+	else if (!stream)
+	{
+		std::for_each(to_fetch.begin(), to_fetch.end(), sample);
+	}
+
+	for (Fetch &f : fetches)
+	{
+		if (!f.values)
 		{
-			if (!ShouldUpdateVar(*dirtyBits, primId, primvar.name))
-				continue;
+			/* This is object-level attributes */
+			SetObjectAttributes(
+				sceneDelegate, nsi, primId, geoHandle, f.primvar);
+			continue;
+		}
 
-			const std::string &primvar_name = primvar.name.GetString();
+		/* The one which decided streaming is already fetched. */
+		if (stream && f.values == &f.fetched && f.fetched.count == 0)
+		{
+			sample(&f);
+		}
+		bool sent = SetOnePrimvar(
+			sceneDelegate, nsi, buffer, motion, primId, geoHandle,
+			vertexIndices, f.primvar, *f.values);
+		count_bytes(f.primvar, *f.values, sent);
+		/* The renderer or the command buffer has its own reference now. */
+		f.fetched = SampleArray();
+	}
 
-			/* Ignore the ones starting with '__' for now. Specifically, we
-			   have no need for __faceindex on subdivs. */
-			if (primvar_name.substr(0, 2) == "__")
+	HdExtComputationPrimvarDescriptorVector dirty_comp;
+	for (const HdExtComputationPrimvarDescriptor &primvar : m_computed)
+	{
+		if (IsFiltered(primvar.name))
+		{
+			ForgetFiltered(nsi, buffer, geoHandle, primvar.name);
+		}
+		else if (ShouldUpdateVar(*dirtyBits, primId, primvar.name))
+		{
+			dirty_comp.emplace_back(primvar);
+		}
+	}
+
+	if (!dirty_comp.empty())
+	{
+		const HdExtComputationUtils::ValueStore valueStore =
+			HdExtComputationUtils::GetComputedPrimvarValues(
+				dirty_comp, sceneDelegate);
+
+		for (const HdExtComputationPrimvarDescriptor &primvar : dirty_comp)
+		{
+			auto value_it = valueStore.find(primvar.name);
+			if (value_it == valueStore.end())
 				continue;
 
-			if( primvar_name.find("nsi:object:") == 0 )
-			{
-				/* This is object-level attributes */
-				SetObjectAttributes(
-					sceneDelegate, nsi, primId, geoHandle, primvar);
-			}
-			else
-			{
-				SampleArray v;
-				sceneDelegate->SamplePrimvar(primId, primvar.name, &v);
-				SetOnePrimvar(
-					sceneDelegate, nsi, primId, geoHandle, vertexIndices,
-					primvar, v);
-			}
+			SampleArray values{value_it->second};
+			bool sent = SetOnePrimvar(
+				sceneDelegate, nsi, buffer, motion, primId, geoHandle,
+				vertexIndices, primvar, values);
+			count_bytes(primvar, values, sent);
 		}
+	}
 
-		HdExtComputationPrimvarDescriptorVector compvars =
-			sceneDelegate->GetExtComputationPrimvarDescriptors(primId, type);
+	m_prefetched.clear();
+	m_descriptors_current = false;
+	*dirtyBits &= ~HdDirtyBits(k_primvar_bits);
+
+	if (report)
+	{
+		report->Add(HdNSIFrameReport::k_primvar_bytes, bytes);
+		report->Add(HdNSIFrameReport::k_skipped_bytes, skipped_bytes);
+		report->Add(HdNSIFrameReport::k_point_count, points);
+	}
+}
+
+/**
+	\brief Fetch the dirty primvars ahead of Sync().
+
+	\returns
+		A hash of all the primvars Sync() will export, or 0 if they can't all
+		be fetched here (computed primvars).
+
+	The values are kept for the next call to Sync() or SkipSync().
+*/
+size_t HdNSIPrimvars::Prefetch(
+	HdSceneDelegate *sceneDelegate,
+	HdDirtyBits dirtyBits,
+	const SdfPath &primId)
+{
+	m_prefetched.clear();
+	if (0 == (dirtyBits & k_primvar_bits))
+		return 0;
 
-		HdExtComputationPrimvarDescriptorVector dirty_comp;
-		for (const HdExtComputationPrimvarDescriptor &primvar : compvars)
+	UpdateDescriptors(sceneDelegate, dirtyBits, primId);
+
+	size_t hash = 1;
+	for (const Descriptor &d : m_descriptors)
+	{
+		const HdPrimvarDescriptor &primvar = d.primvar;
+		if (!d.object && IsFiltered(primvar.name))
+			continue;
+		if (!ShouldUpdateVar(dirtyBits, primId, primvar.name))
+			continue;
+
+		/* This keys the geometry cache, so it hashes the same every session. */
+		hash = HdNSIGeometryCache::Hash(primvar.name.GetString(), hash);
+		hash = HashCombine(hash, primvar.interpolation);
+		hash = HdNSIGeometryCache::Hash(primvar.role.GetString(), hash);
+
+		if (d.object)
 		{
-			if (ShouldUpdateVar(*dirtyBits, primId, primvar.name))
-			{
-				dirty_comp.emplace_back(primvar);
-			}
+			/* Sync() reads those itself. They're small. */
+			hash = HdNSIValueTypes::Hash(
+				sceneDelegate->Get(primId, primvar.name), hash);
+			continue;
 		}
 
-		if (!dirty_comp.empty() )
+		m_prefetched.emplace_back(primvar, SampleArray{});
+		SampleArray &v = m_prefetched.back().second;
+		v.Sample(sceneDelegate, primId, primvar.name);
+		for (size_t i = 0; i < v.count; ++i)
 		{
-			const HdExtComputationUtils::ValueStore valueStore =
-				HdExtComputationUtils::GetComputedPrimvarValues(
-					dirty_comp, sceneDelegate);
-
-			for (const HdExtComputationPrimvarDescriptor &primvar : dirty_comp)
-			{
-				auto value_it = valueStore.find(primvar.name);
-				if (value_it == valueStore.end())
-					continue;
-
-				SetOnePrimvar(
-					sceneDelegate, nsi, primId, geoHandle, vertexIndices,
-					primvar, value_it->second);
-			}
+			hash = HdNSIValueTypes::Hash(VtValue(v.times[i]), hash);
+			hash = HdNSIValueTypes::Hash(v.values[i], hash);
+			hash = HdNSIValueTypes::Hash(VtValue(v.Indices(i)), hash);
 		}
 	}
 
-	*dirtyBits &= ~HdDirtyBits(primvar_bits);
+	if (m_filter)
+	{
+		/* Filtered primvars are deleted. The set's order is not stable. */
+		size_t filter = 0;
+		for (const TfToken &name : *m_filter)
+			filter += HdNSIGeometryCache::Hash(name.GetString());
+		hash = HashCombine(hash, filter);
+	}
+
+	return m_computed.empty() ? hash : 0;
 }
 
-namespace
+/**
+	\brief Drop the prefetched values when the primvars were exported by other
+	means (eg. from a cache).
+
+	This leaves the object in the same state as Sync() would.
+*/
+void HdNSIPrimvars::SkipSync(HdDirtyBits *dirtyBits)
 {
-NSIType_t RoleTo3fType(const TfToken &role)
+	if (0 != (*dirtyBits & HdChangeTracker::DirtyNormals))
+	{
+		m_has_normals = false;
+	}
+	m_points_changed = false;
+	for (const auto &p : m_prefetched)
+	{
+		const HdPrimvarDescriptor &primvar = p.first;
+		const SampleArray &values = p.second;
+		if (values.count == 0 || values.values[0].IsEmpty())
+			continue;
+
+		TrackValue(primvar, values.values[0]);
+		m_points_changed = m_points_changed || primvar.name == HdTokens->points;
+		/* The cache's content is not known. Don't skip the next export. */
+		m_hashes.erase(primvar.name);
+	}
+
+	m_prefetched.clear();
+	m_descriptors_current = false;
+	*dirtyBits &= ~HdDirtyBits(k_primvar_bits);
+}
+
+/*
+	Get the lists of primvars of the prim. They are only fetched again when
+	DirtyPrimvar is set, as other bits (eg. points) can't change the set.
+	Prefetch() and the following Sync() share the same lists.
+*/
+void HdNSIPrimvars::UpdateDescriptors(
+	HdSceneDelegate *sceneDelegate,
+	HdDirtyBits dirtyBits,
+	const SdfPath &primId)
 {
-	if (role == HdPrimvarRoleTokens->vector)
-		return NSITypeVector;
-	if (role == HdPrimvarRoleTokens->normal)
-		return NSITypeNormal;
-	if (role == HdPrimvarRoleTokens->point)
-		return NSITypePoint;
-	/* HdPrimvarRoleTokens->color, also default. */
-	return NSITypeColor;
+	if (m_descriptors_current)
+		return;
+	m_descriptors_current = true;
+	if (m_descriptors_valid &&
+	    0 == (dirtyBits & HdChangeTracker::DirtyPrimvar))
+	{
+		return;
+	}
+	m_descriptors_valid = true;
+
+	m_descriptors.clear();
+	m_computed.clear();
+	for (auto type : types)
+	{
+		for (const HdPrimvarDescriptor &primvar :
+			sceneDelegate->GetPrimvarDescriptors(primId, type))
+		{
+			const std::string &primvar_name = primvar.name.GetString();
+
+			/* Ignore the ones starting with '__' for now. Specifically, we
+			   have no need for __faceindex on subdivs. */
+			if (primvar_name.compare(0, 2, "__") == 0)
+				continue;
+
+			m_descriptors.push_back(Descriptor{
+				primvar, primvar_name.compare(0, 11, "nsi:object:") == 0});
+		}
+
+		HdExtComputationPrimvarDescriptorVector compvars =
+			sceneDelegate->GetExtComputationPrimvarDescriptors(primId, type);
+		m_computed.insert(m_computed.end(), compvars.begin(), compvars.end());
+	}
+}
+
+const HdNSIPrimvars::SampleArray* HdNSIPrimvars::FindPrefetched(
+	const HdPrimvarDescriptor &primvar) const
+{
+	for (const auto &p : m_prefetched)
+	{
+		if (p.first.name == primvar.name)
+			return &p.second;
+	}
+	return nullptr;
 }
 
+namespace
+{
 /*
 	Convert USD primvar name to NSI attribute name.
 */
@@ -141,6 +402,77 @@ std::string TokenToAttName(const TfToken &token)
 		return "width";
 	return token.GetString();
 }
+
+/*
+	Decide which indices go with a primvar's values.
+
+	Values authored with indices keep them when possible, instead of being
+	expanded to one value per face-vertex. Vertex primvars of a mesh have
+	their indices remapped through the mesh's vertex indices.
+
+	\param flattened
+		Receives expanded samples, when the indices can't be kept. They then
+		replace the samples to export.
+	\returns
+		The indices to export, if any.
+*/
+VtIntArray ResolveIndices(
+	const HdPrimvarDescriptor &primvar,
+	const VtIntArray &vertexIndices,
+	const HdNSIPrimvars::SampleArray *&samples,
+	HdNSIPrimvars::SampleArray &flattened)
+{
+	bool per_vertex = !vertexIndices.empty() &&
+		(primvar.interpolation == HdInterpolationVarying ||
+		 primvar.interpolation == HdInterpolationVertex);
+
+	const HdNSIPrimvars::SampleArray &values = *samples;
+	if (values.count == 0 || values.Indices(0).empty())
+		return per_vertex ? vertexIndices : VtIntArray();
+
+	/* There's a single set of indices for all motion samples. */
+	bool same_indices = true;
+	for (size_t i = 1; i < values.count; ++i)
+	{
+		same_indices = same_indices && values.Indices(i) == values.Indices(0);
+	}
+
+	const VtIntArray &indices = values.Indices(0);
+	if (same_indices &&
+	    primvar.interpolation == HdInterpolationFaceVarying)
+	{
+		return indices;
+	}
+	if (same_indices && per_vertex)
+	{
+		VtIntArray remapped(vertexIndices.size());
+		for (size_t i = 0; i < vertexIndices.size(); ++i)
+		{
+			int v = vertexIndices[i];
+			remapped[i] = v >= 0 && size_t(v) < indices.size() ? indices[v] : 0;
+		}
+		return remapped;
+	}
+
+	flattened = values;
+	for (size_t i = 0; i < flattened.count; ++i)
+	{
+		flattened.values[i] =
+			HdNSIValueTypes::Flatten(
+				values.values[i], values.Indices(i));
+	}
+	samples = &flattened;
+	return per_vertex ? vertexIndices : VtIntArray();
+}
+}
+
+/**
+	\returns
+		true if SetAttributeFromValue() can export the value.
+*/
+bool HdNSIPrimvars::IsExportable(const VtValue &value)
+{
+	return HdNSIValueTypes::IsSupported(value);
 }
 
 /**
@@ -171,79 +503,58 @@ bool HdNSIPrimvars::SetAttributeFromValue(
 	double sample_time,
 	bool use_time)
 {
-	const std::string &argName = TokenToAttName(primvar.name);
-
-	if (value.IsHolding<TfToken>())
+	NSI::Argument arg(TokenToAttName(primvar.name));
+	if (!HdNSIValueTypes::FillArgument(
+			arg, value, primvar.role, HdNSIValueTypes::k_primvar))
 	{
-		nsi.SetAttribute(nodeHandle, NSI::StringArg(argName,
-			value.Get<TfToken>().GetString()));
+		return false;
 	}
-	else if (value.IsHolding<std::string>())
+	arg.SetFlags(flags);
+	if (use_time)
 	{
-		nsi.SetAttribute(nodeHandle, NSI::StringArg(argName,
-			value.Get<std::string>()));
+		nsi.SetAttributeAtTime(nodeHandle, sample_time, arg);
 	}
-	else if (value.IsHolding<VtArray<float>>())
+	else
 	{
-		const auto &v_array = value.Get<VtArray<float>>();
-		NSI::Argument arg(argName);
-		arg.SetType(NSITypeFloat);
-		arg.SetCount(v_array.size());
-		arg.SetFlags(flags);
-		arg.SetValuePointer(v_array.cdata());
-		if (use_time)
-		{
-			nsi.SetAttributeAtTime(nodeHandle, sample_time, arg);
-		}
-		else
-		{
-			nsi.SetAttribute(nodeHandle, arg);
-		}
+		nsi.SetAttribute(nodeHandle, arg);
 	}
-	else if (value.IsHolding<VtArray<GfVec2f>>())
+	return true;
+}
+
+/**
+	\returns
+		true if a primvar is not exported because no material reads it.
+*/
+bool HdNSIPrimvars::IsFiltered(const TfToken &var) const
+{
+	return m_filter && m_filter->count(var) == 0;
+}
+
+/*
+	Delete a filtered primvar which was exported before, when the material
+	read it.
+*/
+void HdNSIPrimvars::ForgetFiltered(
+	NSI::Context &nsi,
+	HdNSICommandBuffer *buffer,
+	const std::string &geoHandle,
+	const TfToken &var)
+{
+	if (m_hashes.erase(var) == 0)
+		return;
+
+	std::vector<std::string> names{TokenToAttName(var)};
+	if (m_indexed.erase(var) != 0)
 	{
-		const auto &v_array = value.Get<VtArray<GfVec2f>>();
-		NSI::Argument arg(argName);
-		arg.SetArrayType(NSITypeFloat, 2);
-		arg.SetCount(v_array.size());
-		arg.SetFlags(flags);
-		arg.SetValuePointer(v_array.cdata()->data());
-		if (use_time)
-		{
-			nsi.SetAttributeAtTime(nodeHandle, sample_time, arg);
-		}
-		else
-		{
-			nsi.SetAttribute(nodeHandle, arg);
-		}
+		names.push_back(names[0] + ".indices");
 	}
-	else if (value.IsHolding<VtArray<GfVec3f>>())
+	for (const std::string &name : names)
 	{
-		const auto &v_array = value.Get<VtArray<GfVec3f>>();
-		NSI::Argument arg(argName);
-		arg.SetType(RoleTo3fType(primvar.role));
-		arg.SetCount(v_array.size());
-		arg.SetFlags(flags);
-		arg.SetValuePointer(v_array.cdata()->data());
-		if (use_time)
-		{
-			nsi.SetAttributeAtTime(nodeHandle, sample_time, arg);
-		}
+		if (buffer)
+			buffer->DeleteAttribute(geoHandle, name);
 		else
-		{
-			nsi.SetAttribute(nodeHandle, arg);
-		}
-	}
-	else if (value.IsHolding<int>())
-	{
-		nsi.SetAttribute(nodeHandle, NSI::IntegerArg(argName,
-			value.Get<int>()));
+			nsi.DeleteAttribute(geoHandle, name);
 	}
-	else
-	{
-		return false;
-	}
-	return true;
 }
 
 /**
@@ -318,35 +629,105 @@ void HdNSIPrimvars::SetVisibilityAttributes(
 	nsi.Connect( attribute_handle, "", geoHandle, "geometryattributes" );
 }
 
-void HdNSIPrimvars::SetOnePrimvar(
+/**
+	\brief Export one primvar, unless it is the same as the last export.
+
+	\returns
+		false if nothing was sent.
+*/
+bool HdNSIPrimvars::SetOnePrimvar(
 	HdSceneDelegate *sceneDelegate,
 	NSI::Context &nsi,
+	HdNSICommandBuffer *buffer,
+	const HdNSIMotionSamples &motion,
 	const SdfPath &primId,
 	const std::string &geoHandle,
 	const VtIntArray &vertexIndices,
 	const HdPrimvarDescriptor &primvar,
 	const SampleArray &values)
 {
-	bool has_motion = values.count > 1;
+	bool per_vertex = !vertexIndices.empty() &&
+		(primvar.interpolation == HdInterpolationVarying ||
+		 primvar.interpolation == HdInterpolationVertex);
+
+	/*
+		Hydra often dirties primvars which did not change (eg. scrubbing over
+		held frames). Compare the content with what was last sent.
+	*/
+	size_t hash = HashCombine(primvar.interpolation, primvar.role.Hash());
+	for (size_t i = 0; i < values.count; ++i)
+	{
+		hash = HashCombine(hash, std::hash<float>()(values.times[i]));
+		hash = HashCombine(hash, values.values[i].GetHash());
+		hash = HashCombine(hash, VtValue(values.Indices(i)).GetHash());
+	}
+	if (per_vertex)
+	{
+		/* Only hashed once per Sync(), they are the same for all. */
+		if (m_vertex_indices_hash == 0)
+			m_vertex_indices_hash = VtValue(vertexIndices).GetHash() | 1u;
+		hash = HashCombine(hash, m_vertex_indices_hash);
+	}
+	/* Motion samples are clipped to the shutter, which may change. */
+	if (values.count > 1)
+	{
+		const GfRange1d &shutter = motion.GetShutter();
+		hash = HashCombine(hash, std::hash<double>()(shutter.GetMin()));
+		hash = HashCombine(hash, std::hash<double>()(shutter.GetMax()));
+	}
+
+	auto previous = m_hashes.find(primvar.name);
+	if (previous != m_hashes.end() && previous->second == hash)
+	{
+		for (size_t i = 0; i < values.count; ++i)
+		{
+			TrackValue(primvar, values.values[i]);
+		}
+		return false;
+	}
+	m_hashes.erase(primvar.name);
+
+	/*
+		Huge values are sent right away, instead of being held until the
+		command buffer is flushed. The renderer makes its own copy so ours,
+		and any expanded copy made here, are released on return.
+	*/
+	if (SampleBytes(values) >= k_stream_bytes)
+	{
+		buffer = nullptr;
+	}
+
+	const SampleArray *samples = &values;
+	SampleArray flattened;
+	VtIntArray indices = ResolveIndices(
+		primvar, vertexIndices, samples, flattened);
+
+	/* All the samples now share the indices, if any. */
+	SampleArray reduced;
+	if (samples->count > 1)
+	{
+		reduced = *samples;
+		motion.ReducePrimvar(reduced);
+		samples = &reduced;
+	}
+
+	bool has_motion = samples->count > 1;
 	if (has_motion)
 	{
 		/* Delete previous motion samples so we don't add to them. */
-		nsi.DeleteAttribute(geoHandle, TokenToAttName(primvar.name));
+		if (buffer)
+			buffer->DeleteAttribute(geoHandle, TokenToAttName(primvar.name));
+		else
+			nsi.DeleteAttribute(geoHandle, TokenToAttName(primvar.name));
 	}
-	for (size_t i = 0; i < values.count; ++i )
+	for (size_t i = 0; i < samples->count; ++i )
 	{
-		const VtValue &value = values.values[i];
+		const VtValue &value = samples->values[i];
 		if (value.IsEmpty())
-			return;
+			return true;
 
-		/* Track if we export normals. */
-		m_has_normals = m_has_normals || primvar.name == HdTokens->normals;
-		/* Hold onto points if requested. */
-		if (m_keep_points && primvar.name == HdTokens->points &&
-			value.IsHolding<VtVec3fArray>())
-		{
-			m_points = value.Get<VtVec3fArray>();
-		}
+		TrackValue(primvar, value);
+		m_points_changed = m_points_changed || primvar.name == HdTokens->points;
 
 		int flags = 0;
 		if (primvar.interpolation == HdInterpolationVarying)
@@ -354,25 +735,91 @@ void HdNSIPrimvars::SetOnePrimvar(
 			flags |= NSIParamInterpolateLinear;
 		}
 
-		if (!SetAttributeFromValue(
+		if (buffer)
+		{
+			if (!IsExportable(value))
+				return true;
+			buffer->SetAttribute(
+				geoHandle, primvar, value, flags, samples->times[i],
+				has_motion);
+		}
+		else if (!SetAttributeFromValue(
 				nsi, geoHandle, primvar, value, flags,
-				values.times[i], has_motion))
+				samples->times[i], has_motion))
 		{
-			return;
+			return true;
 		}
 	}
 
 	/* Output indices if needed. */
-	if (!vertexIndices.empty() &&
-	    (primvar.interpolation == HdInterpolationVarying ||
-	     primvar.interpolation == HdInterpolationVertex))
+	if (!indices.empty() && buffer)
+	{
+		buffer->SetIntArray(geoHandle,
+			TokenToAttName(primvar.name) + ".indices", indices);
+	}
+	else if (!indices.empty())
 	{
 		nsi.SetAttribute(geoHandle,
 			*NSI::Argument(TokenToAttName(primvar.name) + ".indices")
 			.SetType(NSITypeInteger)
-			->SetCount(vertexIndices.size())
-			->SetValuePointer(vertexIndices.cdata()));
+			->SetCount(indices.size())
+			->SetValuePointer(indices.cdata()));
+	}
+
+	/* Don't leave the indices of a value which no longer has any. */
+	if (!indices.empty() && !per_vertex)
+	{
+		m_indexed.insert(primvar.name);
+	}
+	else if (indices.empty() && m_indexed.erase(primvar.name) != 0)
+	{
+		if (buffer)
+			buffer->DeleteAttribute(
+				geoHandle, TokenToAttName(primvar.name) + ".indices");
+		else
+			nsi.DeleteAttribute(
+				geoHandle, TokenToAttName(primvar.name) + ".indices");
 	}
+
+	m_hashes[primvar.name] = hash;
+	return true;
+}
+
+/*
+	Keep track of the normals and points of an exported primvar.
+*/
+void HdNSIPrimvars::TrackValue(
+	const HdPrimvarDescriptor &primvar,
+	const VtValue &value)
+{
+	m_has_normals = m_has_normals || primvar.name == HdTokens->normals;
+	/* Hold onto points if requested, as floats like they are exported. */
+	if (m_keep_points && primvar.name == HdTokens->points)
+	{
+		if (value.IsHolding<VtVec3fArray>())
+		{
+			m_points = value.UncheckedGet<VtVec3fArray>();
+		}
+		else
+		{
+			VtValue points = VtValue::Cast<VtVec3fArray>(value);
+			m_points = points.IsEmpty()
+				? VtVec3fArray() : points.UncheckedGet<VtVec3fArray>();
+		}
+	}
+}
+
+/**
+	\brief Drop the reference kept on the exported points.
+
+	\returns
+		The size of the points released.
+*/
+size_t HdNSIPrimvars::ReleasePoints()
+{
+	size_t size = m_points.size() * sizeof(GfVec3f);
+	m_points = VtVec3fArray();
+	return size;
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
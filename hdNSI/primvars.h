@@ -6,10 +6,22 @@
 
 #include <nsi.hpp>
 
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/* Scene delegates can give primvars without flattening their indices. */
+#if defined(PXR_VERSION) && PXR_VERSION >= 2105
+#	define HDNSI_INDEXED_PRIMVARS
+#endif
 
 PXR_NAMESPACE_OPEN_SCOPE
 
+class HdNSICommandBuffer;
+class HdNSIMotionSamples;
 class HdNSIRenderParam;
 
 /*
@@ -29,7 +41,11 @@ public:
 	{
 	}
 
+#ifdef HDNSI_INDEXED_PRIMVARS
+	class SampleArray : public HdIndexedTimeSampleArray<VtValue, 4>
+#else
 	class SampleArray : public HdTimeSampleArray<VtValue, 4>
+#endif
 	{
 	public:
 		SampleArray() = default;
@@ -40,6 +56,30 @@ public:
 			times[0] = 0.0f;
 			values[0] = value;
 		}
+
+		/* Fetch a primvar, keeping it indexed when it was authored so. */
+		void Sample(
+			HdSceneDelegate *sceneDelegate,
+			const SdfPath &primId,
+			const TfToken &name)
+		{
+#ifdef HDNSI_INDEXED_PRIMVARS
+			sceneDelegate->SampleIndexedPrimvar(primId, name, this);
+#else
+			sceneDelegate->SamplePrimvar(primId, name, this);
+#endif
+		}
+
+		/* The indices of a sample. Empty if it is not indexed. */
+		const VtIntArray& Indices(size_t i) const
+		{
+#ifdef HDNSI_INDEXED_PRIMVARS
+			return indices[i];
+#else
+			static const VtIntArray none;
+			return none;
+#endif
+		}
 	};
 
 	void Sync(
@@ -51,6 +91,10 @@ public:
 		const std::string &geoHandle,
 		const VtIntArray &vertexIndices );
 
+	/* Values at least this large are streamed. See Sync(). */
+	static constexpr size_t k_stream_bytes = size_t(64) << 20;
+
+	static bool IsExportable(const VtValue &value);
 	static bool SetAttributeFromValue(
 		NSI::Context &nsi,
 		const std::string &nodeHandle,
@@ -60,27 +104,65 @@ public:
 		double sample_time,
 		bool use_time);
 
+	size_t Prefetch(
+		HdSceneDelegate *sceneDelegate,
+		HdDirtyBits dirtyBits,
+		const SdfPath &primId);
+	void SkipSync(HdDirtyBits *dirtyBits);
+
 	bool HasNormals() const { return m_has_normals; }
+	/* true if the last Sync() actually sent new points. */
+	bool PointsChanged() const { return m_points_changed; }
 	const VtVec3fArray& GetPoints() const { return m_points; }
+	size_t ReleasePoints();
+	/* Export everything again on the next Sync(), eg. to a new node. */
+	void ForgetExported() { m_hashes.clear(); m_indexed.clear(); }
 
 	/* Set primvars which will not be processed. */
 	void SetSkipVars(const TfTokenVector &skip) { m_skip = skip; }
+	/*
+		Only export these primvars, or all of them if null. Object attributes
+		are always processed. Set before Prefetch() and Sync().
+	*/
+	void SetFilter(const std::shared_ptr<const TfToken::Set> &read)
+		{ m_filter = read; }
+	/* If true, another material may need primvars which were filtered. */
+	bool HasFilter() const { return m_filter != nullptr; }
 
 private:
+	bool IsFiltered(const TfToken &var) const;
+	void ForgetFiltered(
+		NSI::Context &nsi,
+		HdNSICommandBuffer *buffer,
+		const std::string &geoHandle,
+		const TfToken &var);
+
 	bool ShouldUpdateVar(
 		HdDirtyBits dirtyBits,
 		const SdfPath &id,
 		const TfToken &var) const;
 
-	void SetOnePrimvar(
+	void UpdateDescriptors(
+		HdSceneDelegate *sceneDelegate,
+		HdDirtyBits dirtyBits,
+		const SdfPath &primId);
+
+	const SampleArray* FindPrefetched(
+		const HdPrimvarDescriptor &primvar) const;
+
+	bool SetOnePrimvar(
 		HdSceneDelegate *sceneDelegate,
 		NSI::Context &nsi,
+		HdNSICommandBuffer *buffer,
+		const HdNSIMotionSamples &motion,
 		const SdfPath &primId,
 		const std::string &geoHandle,
 		const VtIntArray &vertexIndices,
 		const HdPrimvarDescriptor &primvar,
 		const SampleArray &values);
 
+	void TrackValue(const HdPrimvarDescriptor &primvar, const VtValue &value);
+
 	void SetObjectAttributes(
 		HdSceneDelegate *sceneDelegate,
 		NSI::Context &nsi,
@@ -103,6 +185,31 @@ private:
 	VtVec3fArray m_points;
 	/* Skipped primvars. */
 	TfTokenVector m_skip;
+	/* The primvars to export, if not all. See SetFilter(). */
+	std::shared_ptr<const TfToken::Set> m_filter;
+	/* Set by Sync() if the points were exported. */
+	bool m_points_changed{false};
+	/* Hash of the vertex indices given to the current Sync(), or 0. */
+	size_t m_vertex_indices_hash{0};
+	/* Content hash of each exported primvar, to skip unchanged ones. */
+	std::unordered_map<TfToken, size_t, TfToken::HashFunctor> m_hashes;
+	/* Primvars exported with their own indices. */
+	std::unordered_set<TfToken, TfToken::HashFunctor> m_indexed;
+	/* The prim's primvars, in export order. See UpdateDescriptors(). */
+	struct Descriptor
+	{
+		HdPrimvarDescriptor primvar;
+		/* Set by SetObjectAttributes() instead of being exported. */
+		bool object;
+	};
+	std::vector<Descriptor> m_descriptors;
+	HdExtComputationPrimvarDescriptorVector m_computed;
+	/* The lists above were fetched at least once. */
+	bool m_descriptors_valid{false};
+	/* The lists are up to date for the current sync. */
+	bool m_descriptors_current{false};
+	/* Values fetched by Prefetch(), for the next Sync(). */
+	std::vector<std::pair<HdPrimvarDescriptor, SampleArray>> m_prefetched;
 
 };
 
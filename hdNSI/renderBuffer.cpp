@@ -69,8 +69,9 @@ void HdNSIRenderBuffer::Finalize(HdRenderParam *renderParam)
     auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
     /* Stop the render so it does not write to a deleted buffer. */
     nsiRenderParam->StopRender();
-    /* Record that we changed something. */
-    nsiRenderParam->AcquireSceneForEdit();
+    /* Record that we changed something. Unless the scene is going away. */
+    if (!nsiRenderParam->IsDeferringDeletes())
+        nsiRenderParam->AcquireSceneForEdit();
 
     HdRenderBuffer::Finalize(renderParam);
 }
@@ -85,6 +86,7 @@ void HdNSIRenderBuffer::_Deallocate()
     _height = 0;
     _format = HdFormatInvalid;
     _buffer.resize(0);
+    _rowPixels.reset();
 
     _mappers.store(0);
     _converged.store(false);
@@ -109,6 +111,8 @@ bool HdNSIRenderBuffer::Allocate(
     _height = dimensions[1];
     _format = format;
     _buffer.resize(_width * _height * HdDataSizeOfFormat(format));
+    _rowPixels.reset(new std::atomic<unsigned>[_height]);
+    SetCompletedRows(0);
 
     return true;
 }
@@ -133,6 +137,37 @@ void HdNSIRenderBuffer::Resolve()
 {
 }
 
+void HdNSIRenderBuffer::AddRowPixels(unsigned row, unsigned count)
+{
+    if (row < _height)
+        _rowPixels[row].fetch_add(count, std::memory_order_relaxed);
+}
+
+/*
+    Returns the number of rows, from the top, which are all complete.
+*/
+unsigned HdNSIRenderBuffer::GetCompletedRows() const
+{
+    unsigned rows = 0;
+    while (rows < _height &&
+           _rowPixels[rows].load(std::memory_order_relaxed) >= _width)
+    {
+        ++rows;
+    }
+    return rows;
+}
+
+/*
+    Mark the top rows as complete and the others as empty.
+*/
+void HdNSIRenderBuffer::SetCompletedRows(unsigned rows)
+{
+    for (unsigned i = 0; i < _height; ++i)
+    {
+        _rowPixels[i].store(i < rows ? _width : 0u, std::memory_order_relaxed);
+    }
+}
+
 /*
     This sets outputlayer attributes specific to the builtin Hydra AOVs.
 */
@@ -33,6 +33,9 @@
 
 #include <nsi.hpp>
 
+#include <atomic>
+#include <memory>
+
 PXR_NAMESPACE_OPEN_SCOPE
 
 class HdNSIRenderBuffer : public HdRenderBuffer
@@ -81,6 +84,15 @@ public:
         const std::string &layerHandle,
         const HdRenderPassAovBinding &aov) const;
 
+    /*
+        Tracking of the pixels written to each row of the image, with row 0 at
+        the top. Only meaningful for non progressive renders, where each pixel
+        is written once. Used by checkpoints.
+    */
+    void AddRowPixels(unsigned row, unsigned count);
+    unsigned GetCompletedRows() const;
+    void SetCompletedRows(unsigned rows);
+
 private:
     // Release any allocated resources.
     virtual void _Deallocate() override;
@@ -94,6 +106,8 @@ private:
 
     // The resolved output buffer.
     std::vector<uint8_t> _buffer;
+    // Number of pixels written to each row.
+    std::unique_ptr<std::atomic<unsigned>[]> _rowPixels;
 
     // The number of callers mapping this buffer.
     std::atomic<int> _mappers;
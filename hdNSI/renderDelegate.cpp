@@ -29,9 +29,16 @@
 #ifdef ENABLE_ABP
 #   include "accelerationBlurPlugin.h"
 #endif
+#include "asyncNormals.h"
 #include "camera.h"
+#include "checkpoint.h"
 #include "curves.h"
+#ifdef ENABLE_DISTRIBUTED
+#   include "distributedRender.h"
+#endif
 #include "field.h"
+#include "frameReport.h"
+#include "geometryCache.h"
 #include "light.h"
 #include "material.h"
 #include "mesh.h"
@@ -40,22 +47,28 @@
 #include "renderBuffer.h"
 #include "renderParam.h"
 #include "renderPass.h"
+#include "sharedShapes.h"
 #include "tokens.h"
 #include "volume.h"
 
+#include <pxr/base/arch/fileSystem.h>
 #include <pxr/base/plug/plugin.h>
 #include <pxr/base/plug/thisPlugin.h>
 #include <pxr/base/js/json.h>
 #include <pxr/base/tf/getenv.h>
 #include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/pathUtils.h>
 #include <pxr/imaging/hd/camera.h>
 #include <pxr/imaging/hd/extComputation.h>
 #include <pxr/imaging/hd/resourceRegistry.h>
 
 #include <delight.h>
 
+#include <algorithm>
 #include <iostream>
 #include <cassert>
+#include <cstdio>
+#include <unordered_map>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
@@ -66,6 +79,57 @@ TF_DEFINE_PRIVATE_TOKENS(
     (openvdbAsset)
 );
 
+namespace
+{
+/*
+    The renderer's library is loaded once and shared by all delegates of the
+    process, with our output driver registered in it. Services which create a
+    delegate per job then don't pay for this each time. It is never unloaded.
+*/
+std::shared_ptr<NSI::DynamicAPI> SharedAPI()
+{
+    static std::shared_ptr<NSI::DynamicAPI> *api = []()
+    {
+        auto *api = new std::shared_ptr<NSI::DynamicAPI>(new NSI::DynamicAPI);
+
+        /* Init output driver too. */
+        HdNSIOutputDriver::Register(**api);
+
+        decltype(&DlGetLibNameAndVersionString) PDlGetLibNameAndVersionString;
+        (*api)->LoadFunction(PDlGetLibNameAndVersionString,
+            "DlGetLibNameAndVersionString");
+        decltype(&DlGetInstallRoot) PDlGetInstallRoot;
+        (*api)->LoadFunction(PDlGetInstallRoot, "DlGetInstallRoot");
+        if (PDlGetLibNameAndVersionString && PDlGetInstallRoot) {
+            TF_STATUS("hdNSI is using %s at '%s'",
+                PDlGetLibNameAndVersionString(), PDlGetInstallRoot());
+        }
+        return api;
+    }();
+    return *api;
+}
+
+/*
+    NSI contexts left by service mode delegates, ready for the next one. The
+    render index has removed the whole scene from them so they hold only the
+    default material. They are not ended at exit.
+*/
+struct PooledContext
+{
+    std::shared_ptr<NSI::Context> nsi;
+    /* Options the context was configured for. */
+    std::string key;
+    std::vector<DlShaderInfo*> default_shaders;
+};
+const size_t k_max_pooled_contexts = 4;
+std::mutex g_context_pool_mutex;
+std::vector<PooledContext>& ContextPool()
+{
+    static auto *pool = new std::vector<PooledContext>;
+    return *pool;
+}
+}
+
 const TfTokenVector HdNSIRenderDelegate::SUPPORTED_RPRIM_TYPES =
 {
     HdPrimTypeTokens->mesh,
@@ -133,10 +197,7 @@ HdNSIRenderDelegate::HdNSIRenderDelegate(
     HdRenderDelegate{settingsMap}
 {
     // Initialize the NSI context with dynamic API.
-    _capi.reset(new NSI::DynamicAPI);
-
-    /* Init output driver too. */
-    HdNSIOutputDriver::Register(*_capi);
+    _capi = SharedAPI();
 
     /* Init install root path. */
     decltype(&DlGetInstallRoot) PDlGetInstallRoot;
@@ -149,14 +210,6 @@ HdNSIRenderDelegate::HdNSIRenderDelegate(
     PlugPluginPtr plugin = PLUG_THIS_PLUGIN;
     _shaders_path = PlugFindPluginResource(plugin, "osl", false);
 
-    decltype(&DlGetLibNameAndVersionString) PDlGetLibNameAndVersionString;
-    _capi->LoadFunction(PDlGetLibNameAndVersionString,
-        "DlGetLibNameAndVersionString");
-    if (PDlGetLibNameAndVersionString) {
-        TF_STATUS("hdNSI is using %s at '%s'",
-            PDlGetLibNameAndVersionString(), _delight.c_str());
-    }
-
     _capi->LoadFunction(m_DlGetShaderInfo, "DlGetShaderInfo");
 
     // Initialize one resource registry for all NSI plugins
@@ -234,7 +287,6 @@ HdNSIRenderDelegate::HdNSIRenderDelegate(
 void HdNSIRenderDelegate::CreateNSIContext()
 {
     _nsi = std::make_shared<NSI::Context>(*_capi);
-    NSI::ArgumentList beginArgs;
     std::string trace_file = TfGetenv("HDNSI_TRACE");
     std::string stream_product;
     bool display_product;
@@ -252,26 +304,98 @@ void HdNSIRenderDelegate::CreateNSIContext()
             delegateOptions = v.GetJsObject();
     }
 
+    /*
+        Stream options, as:
+        "outputstream": {"filename": "path", "format": "binarynsi",
+                         "compression": "gzip", "delta": true}
+        The filename is only used when there is no nsi:apistream product.
+    */
+    JsObject os;
+    if( delegateOptions["outputstream"].IsObject() )
+        os = delegateOptions["outputstream"].GetJsObject();
+    m_stream_format = TfGetenv("HDNSI_STREAM_FORMAT");
+    if( os["format"].IsString() )
+        m_stream_format = os["format"].GetString();
+    m_stream_compression = TfGetenv("HDNSI_STREAM_COMPRESSION");
+    if( os["compression"].IsString() )
+        m_stream_compression = os["compression"].GetString();
+
     if (!trace_file.empty())
     {
-        beginArgs.push(new NSI::StringArg("streamfilename", trace_file));
+        m_stream_filename = trace_file;
     }
     else if( !stream_product.empty() )
     {
         m_apistream_product = true;
-        beginArgs.push(new NSI::StringArg("streamfilename", stream_product));
-        beginArgs.push(new NSI::StringArg("streamformat", "autonsi"));
+        m_stream_filename = stream_product;
+        if( m_stream_format.empty() )
+            m_stream_format = "autonsi";
+        m_delta_streams = os["delta"] == JsValue(true);
+        m_delta_product = stream_product;
     }
     else if( delegateOptions["outputstream"].IsObject() )
     {
         m_apistream_product = true;
-        JsObject os = delegateOptions["outputstream"].GetJsObject();
-        std::string fn = "stdout";
+        m_stream_filename = "stdout";
         if( os["filename"].IsString() )
-            fn = os["filename"].GetString();
-        beginArgs.push(new NSI::StringArg("streamfilename", fn));
+            m_stream_filename = os["filename"].GetString();
+    }
+
+    /*
+        Batch frames rendered by several renderdl processes, as:
+        "distributed": {"workers": 4, "command": "renderdl",
+                        "directory": "path"}
+        The scene is streamed to the directory for the workers to read.
+    */
+    JsValue distributed = delegateOptions["distributed"];
+    if( distributed.IsObject() && IsBatch() && m_stream_filename.empty() )
+    {
+#ifdef ENABLE_DISTRIBUTED
+        JsObject dist = distributed.GetJsObject();
+        unsigned workers = dist["workers"].IsInt()
+            ? unsigned(std::max(dist["workers"].GetInt(), 1))
+            : 2u;
+        std::string command = dist["command"].IsString()
+            ? dist["command"].GetString()
+            : TfStringCatPaths(TfStringCatPaths(_delight, "bin"), "renderdl");
+        std::string directory = dist["directory"].IsString()
+            ? dist["directory"].GetString()
+            : TfStringCatPaths(ArchGetTmpDir(), "hdnsi_distributed");
+        m_distributed.reset(new HdNSIDistributedRender(
+            *_capi, workers, command, directory));
+        m_stream_filename = m_distributed->BeginSceneSegment();
+        if( m_stream_format.empty() )
+            m_stream_format = "binarynsi";
+#else
+        TF_WARN("Distributed rendering requires a newer USD");
+#endif
+    }
+
+    /*
+        Service mode, for hosts which render many small jobs back to back:
+        "service": true
+        The context is reused from a previous delegate, if any.
+    */
+    bool reused_context = false;
+    if( delegateOptions["service"] == JsValue(true) &&
+        m_stream_filename.empty() )
+    {
+        m_service = true;
+        m_service_key = delegateOptionsStr.IsHolding<std::string>()
+            ? delegateOptionsStr.UncheckedGet<std::string>() : std::string();
+        if( IsBatch() )
+            m_service_key += "\nbatch";
+        reused_context = TakePooledContext();
+    }
+
+    if( !m_stream_filename.empty() )
+    {
+        BeginStream(m_stream_filename);
+    }
+    else if( !reused_context )
+    {
+        _nsi->Begin();
     }
-    _nsi->Begin(beginArgs);
 
     // Store top-level NSI objects inside a render param that can be
     // passed to prims during Sync().
@@ -288,6 +412,45 @@ void HdNSIRenderDelegate::CreateNSIContext()
     SetMaxHairDepth();
     SetMaxDistance();
 
+    /*
+        Checkpoints of batch renders, as:
+        "checkpoint": {"directory": "path", "interval": 300, "key": "scene"}
+    */
+    JsValue checkpoint = delegateOptions["checkpoint"];
+    if( IsBatch() && checkpoint.IsObject() )
+    {
+        JsObject cp = checkpoint.GetJsObject();
+        if( cp["directory"].IsString() )
+        {
+            double interval =
+                cp["interval"].IsReal() ? cp["interval"].GetReal() :
+                cp["interval"].IsInt() ? cp["interval"].GetInt() : 300.0;
+            std::string key =
+                cp["key"].IsString() ? cp["key"].GetString() : "";
+            m_checkpoint.reset(new HdNSICheckpoint(
+                cp["directory"].GetString(), interval, key));
+        }
+        else
+        {
+            TF_WARN("checkpoint option requires a directory");
+        }
+    }
+
+    /*
+        Cache of exported static geometry, as:
+        "geometrycache": {"directory": "path"}
+    */
+    std::string geometry_cache = TfGetenv("HDNSI_GEOMETRY_CACHE");
+    JsValue gc = delegateOptions["geometrycache"];
+    if( gc.IsObject() && gc.GetJsObject()["directory"].IsString() )
+    {
+        geometry_cache = gc.GetJsObject()["directory"].GetString();
+    }
+    if( !geometry_cache.empty() )
+    {
+        m_geometry_cache.reset(new HdNSIGeometryCache(*_capi, geometry_cache));
+    }
+
     /* We want bucket order set when it is visible. */
     if( !IsBatch() || display_product )
     {
@@ -295,6 +458,124 @@ void HdNSIRenderDelegate::CreateNSIContext()
             NSI::StringArg("bucketorder", "spiral"),
             NSI::IntegerArg("renderatlowpriority", 1)));
     }
+    else if( m_checkpoint )
+    {
+        /* Checkpoints save the complete rows at the top of the image. */
+        _nsi->SetAttribute(NSI_SCENE_GLOBAL,
+            NSI::StringArg("bucketorder", "horizontal"));
+    }
+
+    /*
+        Let a batch frame with only file outputs finish rendering while
+        Hydra moves on to the next frame, as:
+        "pipeline": true
+        The next frame's edits are recorded until all its prims are synced,
+        and only then applied to the scene once the render is done.
+    */
+    if( IsBatch() && delegateOptions["pipeline"] == JsValue(true) )
+    {
+        m_pipelined_batch = true;
+    }
+
+    /*
+        Release the translation side data of prims once it is exported, as:
+        "lean": true
+        This lowers peak memory. Prims which are edited later (eg. in the next
+        frame of a sequence) fetch all their data again, once, and then keep
+        it.
+    */
+    if( IsBatch() && delegateOptions["lean"] == JsValue(true) )
+    {
+        m_lean_batch = true;
+    }
+
+    /*
+        Let interactive renders start with the previous smooth normals of
+        deforming meshes while new ones are computed, as:
+        "asyncnormals": true
+    */
+    if( !IsBatch() && delegateOptions["asyncnormals"] == JsValue(true) )
+    {
+        m_async_normals.reset(new HdNSIAsyncNormals);
+    }
+
+    /*
+        Let transforms which rotate fast get more motion samples, up to a
+        count, as:
+        "transformsamples": 8
+        The added samples are not read from the scene. They interpolate the
+        rotation of the samples around them along the shortest arc, and the
+        translation and scale linearly. This fixes the shrinking of matrix
+        interpolation but not a motion which changes speed or axis between
+        the scene's samples.
+    */
+    JsValue transform_samples = delegateOptions["transformsamples"];
+    if( transform_samples.IsInt() && transform_samples.GetInt() > 1 )
+    {
+        _renderParam->GetMotionSamples().SetMaxTransformSamples(
+            transform_samples.GetInt());
+    }
+
+    /*
+        Export meshes with identical content only once, as instances of the
+        same geometry, as:
+        "autoinstance": true
+    */
+    if( delegateOptions["autoinstance"] == JsValue(true) )
+    {
+        m_shared_shapes.reset(new HdNSISharedShapes);
+    }
+
+    /*
+        Only export the primvars which the bound materials read, as:
+        "primvarfilter": true
+        Primvars used by other means (eg. render time procedurals) can be
+        kept with:
+        "primvarfilter": {"keep": ["name", ...]}
+    */
+    JsValue primvar_filter = delegateOptions["primvarfilter"];
+    if( primvar_filter == JsValue(true) || primvar_filter.IsObject() )
+    {
+        TfToken::Set kept{
+            HdTokens->points, HdTokens->normals, HdTokens->widths};
+        JsValue keep = primvar_filter.IsObject()
+            ? primvar_filter.GetJsObject()["keep"] : JsValue();
+        if( keep.IsArray() )
+        {
+            for( const JsValue &name : keep.GetJsArray() )
+            {
+                if( name.IsString() )
+                    kept.insert(TfToken(name.GetString()));
+            }
+        }
+        m_kept_primvars = std::make_shared<const TfToken::Set>(kept);
+
+        /* See ExportDefaultMaterial(). */
+        kept.insert(HdTokens->displayColor);
+        kept.insert(HdTokens->displayOpacity);
+        m_default_material_primvars =
+            std::make_shared<const TfToken::Set>(kept);
+    }
+
+    /*
+        Performance numbers of each batch frame, appended as JSON lines, as:
+        "framereport": "path"
+    */
+    std::string frame_report = TfGetenv("HDNSI_FRAME_REPORT");
+    if( delegateOptions["framereport"].IsString() )
+    {
+        frame_report = delegateOptions["framereport"].GetString();
+    }
+    if( IsBatch() && !frame_report.empty() )
+    {
+        m_frame_report.reset(new HdNSIFrameReport(frame_report));
+    }
+
+    if( delegateOptions["progress"] == JsValue(true) ||
+        os["report"] == JsValue(true) )
+    {
+        m_stream_report = true;
+    }
 
     if( delegateOptions["progress"] == JsValue(true) )
     {
@@ -302,11 +583,49 @@ void HdNSIRenderDelegate::CreateNSIContext()
             NSI::IntegerArg("statistics.progress", 1));
     }
 
-    ExportDefaultMaterial();
+    /* A reused context still has it. */
+    if( !reused_context )
+        ExportDefaultMaterial();
 
     _exportedSettings = _settingsMap;
 }
 
+/*
+    Take a context left by a previous service mode delegate with the same
+    options.
+*/
+bool HdNSIRenderDelegate::TakePooledContext()
+{
+    std::lock_guard<std::mutex> lock(g_context_pool_mutex);
+    std::vector<PooledContext> &pool = ContextPool();
+    for( auto it = pool.begin(); it != pool.end(); ++it )
+    {
+        if( it->key == m_service_key )
+        {
+            _nsi = it->nsi;
+            m_default_shaders = it->default_shaders;
+            pool.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    Keep the context for the next service mode delegate. The render index
+    has already removed all the prims so only what the delegate itself
+    exported is left.
+*/
+void HdNSIRenderDelegate::ReturnPooledContext()
+{
+    std::lock_guard<std::mutex> lock(g_context_pool_mutex);
+    std::vector<PooledContext> &pool = ContextPool();
+    if( pool.size() >= k_max_pooled_contexts )
+        return;
+    pool.push_back({_nsi, m_service_key, m_default_shaders});
+    _nsi.reset();
+}
+
 HdNSIRenderDelegate::~HdNSIRenderDelegate()
 {
     // Clean the resource registry only when it is the last NSI delegate
@@ -316,8 +635,37 @@ HdNSIRenderDelegate::~HdNSIRenderDelegate()
         _resourceRegistry.reset();
     }
 
-    // Destroy NSI context.
+    // Destroy NSI context, after the last frame of a pipelined batch is done.
+    if( _renderParam )
+    {
+        _renderParam->FinishPendingRender();
+        /* A pooled context must not keep the removed prims. Otherwise, they
+           all go away with the context. */
+        if( m_service )
+            _renderParam->FlushDeferredDeletes();
+    }
     _renderParam.reset();
+
+    if( m_service && _nsi )
+    {
+        ReturnPooledContext();
+    }
+
+#ifdef ENABLE_DISTRIBUTED
+    /* The last scene segment must be closed before it is removed. */
+    if( m_distributed )
+    {
+        _nsi.reset();
+        m_distributed.reset();
+    }
+#endif
+
+    /* The edits after the last frame of delta streams are not a frame. */
+    if( !m_delta_pending.empty() )
+    {
+        _nsi.reset();
+        TfDeleteFile(m_delta_pending);
+    }
 }
 
 HdRenderParam*
@@ -345,6 +693,20 @@ HdNSIRenderDelegate::CommitResources(HdChangeTracker *tracker)
     // HdEngine::Execute().
     // XXX TODO: does NSI need a sort of commit? don't think so...
     // nsiCommit(_nsi_ctx);
+
+    /* Send the attribute edits prims recorded while synced in parallel. */
+    _renderParam->FlushCommands();
+    if( m_async_normals )
+        m_async_normals->Flush(*_renderParam);
+
+    size_t released = m_released_bytes.exchange(0);
+    size_t refetched = m_refetched_bytes.exchange(0);
+    if( released != 0 || refetched != 0 )
+    {
+        TF_STATUS("Released %.1f MB of exported prim data, fetched %.1f MB "
+            "again", released / (1024.0 * 1024.0),
+            refetched / (1024.0 * 1024.0));
+    }
 }
 
 TfToken HdNSIRenderDelegate::GetMaterialBindingPurpose() const
@@ -519,6 +881,8 @@ HdNSIRenderDelegate::CreateRenderPass(HdRenderIndex *index,
     auto pass = new HdNSIRenderPass(
         index, collection, this, _renderParam.get());
     _renderPasses.push_back(pass);
+    /* The scene is in use. Prims removed from now on are deleted. */
+    _renderParam->SetDeferDeletes(false);
     return HdRenderPassSharedPtr(pass);
 }
 
@@ -686,9 +1050,52 @@ void HdNSIRenderDelegate::RemoveRenderPass(HdNSIRenderPass *renderPass)
     _renderPasses.erase(
         std::remove(_renderPasses.begin(), _renderPasses.end(), renderPass),
         _renderPasses.end());
+
+    if (renderPass->IsIdRender())
+        IdRenderChanged();
+
+    /* Likely teardown. See HdNSIRenderParam::DeleteNode(). */
+    if (_renderPasses.empty() && _renderParam)
+        _renderParam->SetDeferDeletes(true);
+}
+
+/*
+    Called when a render pass enters or leaves its id only mode. If every pass
+    is rendering ids, nothing needs real shading so we apply the same override
+    as the disableLighting setting.
+*/
+void HdNSIRenderDelegate::IdRenderChanged() const
+{
+    if (_nsi)
+        SetDisableLighting();
 }
 
 const std::string HdNSIRenderDelegate::FindShader(const std::string &id) const
+{
+    /*
+        Shaders don't move while we run. Remember them for all delegates
+        which search the same directories.
+    */
+    static std::mutex found_mutex;
+    static std::unordered_map<std::string, std::string> found;
+    const std::string key = _shaders_path + '\n' + _delight + '\n' + id;
+    {
+        std::lock_guard<std::mutex> lock(found_mutex);
+        auto it = found.find(key);
+        if (it != found.end())
+            return it->second;
+    }
+
+    std::string path = FindShaderFile(id);
+    if (path != id)
+    {
+        std::lock_guard<std::mutex> lock(found_mutex);
+        found.emplace(key, path);
+    }
+    return path;
+}
+
+std::string HdNSIRenderDelegate::FindShaderFile(const std::string &id) const
 {
     std::string filename = id + ".oso";
 
@@ -749,8 +1156,9 @@ DlShaderInfo* HdNSIRenderDelegate::GetDefaultShader(
     /* Keep track of which shaders we've already created. */
     m_default_shaders.push_back(si);
     /* Actually create it. */
-    _nsi->Create(*handle, "shader");
-    _nsi->SetAttribute(*handle, NSI::StringArg("shaderfilename", path));
+    NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
+    nsi.Create(*handle, "shader");
+    nsi.SetAttribute(*handle, NSI::StringArg("shaderfilename", path));
 
     return si;
 }
@@ -776,6 +1184,127 @@ bool HdNSIRenderDelegate::IsBatch() const
     return render_mode == batch;
 }
 
+/*
+    Begin the context with output to a stream file.
+*/
+void HdNSIRenderDelegate::BeginStream(const std::string &filename)
+{
+    NSI::ArgumentList beginArgs;
+    beginArgs.push(new NSI::StringArg("streamfilename", filename));
+    /* binarynsi is much smaller and faster to write and parse. */
+    if( !m_stream_format.empty() )
+    {
+        beginArgs.push(new NSI::StringArg("streamformat", m_stream_format));
+    }
+    if( !m_stream_compression.empty() )
+    {
+        beginArgs.push(new NSI::StringArg(
+            "streamcompression", m_stream_compression));
+    }
+    _nsi->Begin(beginArgs);
+    m_stream_start = std::chrono::steady_clock::now();
+}
+
+/*
+    Called once a frame has been written to the stream.
+
+    Normally, the context is then reset so the Delete calls of the teardown
+    don't get exported. With delta streams, the context instead starts
+    recording the edits for the next frame into a new stream. That stream is
+    written to a temporary file and renamed to the product's name once the
+    frame is complete, as the name is not known before. So the first frame's
+    stream is a complete scene and each following one only has the changes.
+    A sequence is rendered by giving all the streams, in order, to renderdl.
+*/
+void HdNSIRenderDelegate::StreamExported()
+{
+    if( !m_delta_streams )
+    {
+        /* The stream is only complete, and of its final size, once ended. */
+        _nsi->End();
+        ReportStreamExport();
+        /* Reset the context so the Delete calls don't get exported. */
+        _nsi->Begin();
+        return;
+    }
+
+    /* Close the stream so it is complete before renaming it. */
+    _nsi->End();
+
+    if( !m_delta_pending.empty() )
+    {
+        std::string product;
+        bool display_product;
+        HdNSIRenderPass::FindProducts(this, product, display_product);
+        std::string target = product;
+        if( product == m_delta_product )
+        {
+            /* Not a per frame name. Avoid writing over the previous one. */
+            target += "." + std::to_string(++m_delta_count);
+        }
+        if( TfPathExists(target) )
+            TfDeleteFile(target);
+        if( std::rename(m_delta_pending.c_str(), target.c_str()) != 0 )
+        {
+            TF_WARN("Unable to rename '%s' to '%s'",
+                m_delta_pending.c_str(), target.c_str());
+        }
+        m_stream_filename = target;
+        m_delta_product = product;
+    }
+    ReportStreamExport();
+
+    /* Keep the product's extension so autonsi picks the same format. */
+    std::string ext = TfGetExtension(m_delta_product);
+    m_delta_pending = m_delta_product + ".hdnsidelta";
+    if( !ext.empty() )
+        m_delta_pending += "." + ext;
+    BeginStream(m_delta_pending);
+}
+
+/*
+    Called when a frame's edits are complete, before it is distributed. They
+    are closed into a scene segment and the next frame's edits go to a new
+    one, which the workers will read after it.
+*/
+void HdNSIRenderDelegate::EndSceneSegment()
+{
+#ifdef ENABLE_DISTRIBUTED
+    _nsi->End();
+    ReportStreamExport();
+    m_stream_filename = m_distributed->BeginSceneSegment();
+    BeginStream(m_stream_filename);
+#endif
+}
+
+/*
+    Print the size of the exported stream and how long it took to produce.
+    Called once the stream has been ended, so it is completely written and
+    compressed.
+*/
+void HdNSIRenderDelegate::ReportStreamExport()
+{
+    if( !m_stream_report || m_stream_filename.empty() )
+        return;
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - m_stream_start).count();
+    int64_t size = ArchGetFileLength(m_stream_filename.c_str());
+    if( size >= 0 )
+    {
+        TF_STATUS("Exported NSI stream '%s': %lld bytes in %.2fs",
+            m_stream_filename.c_str(), (long long)size, seconds);
+    }
+    else
+    {
+        TF_STATUS("Exported NSI stream '%s' in %.2fs",
+            m_stream_filename.c_str(), seconds);
+    }
+
+    /* The next export, if any, starts now. */
+    m_stream_start = std::chrono::steady_clock::now();
+}
+
 void HdNSIRenderDelegate::ProgressUpdate(const NSI::ProgressCallback::Value &i_progress)
 {
     std::lock_guard<std::mutex> guard(m_render_stats_mutex);
@@ -783,6 +1312,9 @@ void HdNSIRenderDelegate::ProgressUpdate(const NSI::ProgressCallback::Value &i_p
     m_render_stats["seconds_rendering"] = i_progress.m_seconds_rendering;
     m_render_stats["render_passes"] = GfVec2i(
         i_progress.m_completed_passes, i_progress.m_total_passes);
+
+    if( m_frame_report )
+        m_frame_report->Progress(i_progress.m_render_progress);
 }
 
 void HdNSIRenderDelegate::SetDisableLighting() const
@@ -793,24 +1325,32 @@ void HdNSIRenderDelegate::SetDisableLighting() const
     VtValue s = GetRenderSetting(HdNSIRenderSettingsTokens->disableLighting);
     /* Houdini sends an int. Cast it. */
     s.Cast<bool>();
+    bool disable = !s.IsEmpty() && s.Get<bool>();
+
+    /* Passes which only output ids don't need shading either. */
+    bool id_only = !_renderPasses.empty();
+    for (const HdNSIRenderPass *pass : _renderPasses)
+    {
+        id_only = id_only && pass->IsIdRender();
+    }
 
     /* Get the context this way to force synchronization. */
-	NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
-    if( !s.IsEmpty() && s.Get<bool>() )
+    NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
+    if( disable || id_only )
     {
-        _nsi->Create(baseHandle, "attributes");
-        _nsi->SetAttribute(baseHandle, NSI::IntegerArg("priority", 1));
-        _nsi->Connect(baseHandle, "", NSI_SCENE_ROOT, "geometryattributes");
+        nsi.Create(baseHandle, "attributes");
+        nsi.SetAttribute(baseHandle, NSI::IntegerArg("priority", 1));
+        nsi.Connect(baseHandle, "", NSI_SCENE_ROOT, "geometryattributes");
 
-        _nsi->Create(shaderHandle, "shader");
-        _nsi->Connect(shaderHandle, "", baseHandle, "surfaceshader");
-        _nsi->SetAttribute(shaderHandle,
+        nsi.Create(shaderHandle, "shader");
+        nsi.Connect(shaderHandle, "", baseHandle, "surfaceshader");
+        nsi.SetAttribute(shaderHandle,
             NSI::StringArg("shaderfilename", FindShader("NoLightingSurface")));
     }
     else
     {
-        _nsi->Delete(shaderHandle);
-        _nsi->Delete(baseHandle);
+        nsi.Delete(shaderHandle);
+        nsi.Delete(baseHandle);
     }
 }
 
@@ -818,7 +1358,7 @@ void HdNSIRenderDelegate::SetShadingSamples() const
 {
     VtValue s = GetRenderSetting(HdNSIRenderSettingsTokens->shadingSamples);
 
-    _nsi->SetAttribute(NSI_SCENE_GLOBAL,
+    _renderParam->AcquireSceneForEdit().SetAttribute(NSI_SCENE_GLOBAL,
         NSI::IntegerArg("quality.shadingsamples", s.Get<int>()));
 }
 
@@ -826,7 +1366,7 @@ void HdNSIRenderDelegate::SetVolumeSamples() const
 {
     VtValue s = GetRenderSetting(HdNSIRenderSettingsTokens->volumeSamples);
 
-    _nsi->SetAttribute(NSI_SCENE_GLOBAL,
+    _renderParam->AcquireSceneForEdit().SetAttribute(NSI_SCENE_GLOBAL,
         NSI::IntegerArg("quality.volumesamples", s.Get<int>()));
 }
 
@@ -834,7 +1374,7 @@ void HdNSIRenderDelegate::SetMaxDiffuseDepth() const
 {
     VtValue s = GetRenderSetting(HdNSIRenderSettingsTokens->maximumDiffuseDepth);
 
-    _nsi->SetAttribute(NSI_SCENE_GLOBAL,
+    _renderParam->AcquireSceneForEdit().SetAttribute(NSI_SCENE_GLOBAL,
         NSI::IntegerArg("maximumraydepth.diffuse", s.Get<int>()));
 }
 
@@ -842,7 +1382,7 @@ void HdNSIRenderDelegate::SetMaxReflectionDepth() const
 {
     VtValue s = GetRenderSetting(HdNSIRenderSettingsTokens->maximumReflectionDepth);
 
-    _nsi->SetAttribute(NSI_SCENE_GLOBAL,
+    _renderParam->AcquireSceneForEdit().SetAttribute(NSI_SCENE_GLOBAL,
         NSI::IntegerArg("maximumraydepth.reflection", s.Get<int>()));
 }
 
@@ -850,7 +1390,7 @@ void HdNSIRenderDelegate::SetMaxRefractionDepth() const
 {
     VtValue s = GetRenderSetting(HdNSIRenderSettingsTokens->maximumRefractionDepth);
 
-    _nsi->SetAttribute(NSI_SCENE_GLOBAL,
+    _renderParam->AcquireSceneForEdit().SetAttribute(NSI_SCENE_GLOBAL,
         NSI::IntegerArg("maximumraydepth.refraction", s.Get<int>()));
 }
 
@@ -858,7 +1398,7 @@ void HdNSIRenderDelegate::SetMaxHairDepth() const
 {
     VtValue s = GetRenderSetting(HdNSIRenderSettingsTokens->maximumHairDepth);
 
-    _nsi->SetAttribute(NSI_SCENE_GLOBAL,
+    _renderParam->AcquireSceneForEdit().SetAttribute(NSI_SCENE_GLOBAL,
         NSI::IntegerArg("maximumraydepth.hair", s.Get<int>()));
 }
 
@@ -867,7 +1407,7 @@ void HdNSIRenderDelegate::SetMaxDistance() const
     VtValue s = GetRenderSetting(HdNSIRenderSettingsTokens->maximumDistance);
     double l = s.IsHolding<float>() ? s.Get<float>() : s.Get<double>();
 
-    _nsi->SetAttribute(NSI_SCENE_GLOBAL,
+    _renderParam->AcquireSceneForEdit().SetAttribute(NSI_SCENE_GLOBAL,
         NSI::DoubleArg("maximumraylength.diffuse", l));
 }
 
@@ -35,12 +35,20 @@
 #include <3Delight/ShaderQuery.h>
 #include <nsi_dynamic.hpp>
 
+#include <atomic>
+#include <chrono>
 #include <mutex>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
+class HdNSIAsyncNormals;
+class HdNSICheckpoint;
+class HdNSIDistributedRender;
+class HdNSIFrameReport;
+class HdNSIGeometryCache;
 class HdNSIRenderParam;
 class HdNSIRenderPass;
+class HdNSISharedShapes;
 
 ///
 /// \class HdNSIRenderDelegate
@@ -215,6 +223,7 @@ public:
         TfToken const& name) const override;
 
     void RemoveRenderPass(HdNSIRenderPass *renderPass);
+    void IdRenderChanged() const;
 
     const std::string& GetDelight() const { return _delight; }
 
@@ -232,11 +241,38 @@ public:
 
     bool IsBatch() const;
     bool HasAPIStreamProduct() const { return m_apistream_product; }
+    bool IsPipelinedBatch() const { return m_pipelined_batch; }
+    NSI::DynamicAPI& GetAPI() const { return *_capi; }
+    HdNSICheckpoint* GetCheckpoint() const { return m_checkpoint.get(); }
+    HdNSIGeometryCache* GetGeometryCache() const
+        { return m_geometry_cache.get(); }
+    HdNSIDistributedRender* GetDistributedRender() const
+        { return m_distributed.get(); }
+    HdNSIFrameReport* GetFrameReport() const { return m_frame_report.get(); }
+    HdNSIAsyncNormals* GetAsyncNormals() const
+        { return m_async_normals.get(); }
+    HdNSISharedShapes* GetSharedShapes() const
+        { return m_shared_shapes.get(); }
+    bool IsLeanBatch() const { return m_lean_batch; }
+    const std::shared_ptr<const TfToken::Set>& GetKeptPrimvars() const
+        { return m_kept_primvars; }
+    const std::shared_ptr<const TfToken::Set>&
+        GetDefaultMaterialPrimvars() const
+        { return m_default_material_primvars; }
+    void MemoryReleased(size_t bytes) { m_released_bytes += bytes; }
+    void MemoryRefetched(size_t bytes) { m_refetched_bytes += bytes; }
 
     void ProgressUpdate(const NSI::ProgressCallback::Value &i_progress);
+    void StreamExported();
+    void EndSceneSegment();
 
 private:
     void CreateNSIContext();
+    void BeginStream(const std::string &filename);
+    void ReportStreamExport();
+    bool TakePooledContext();
+    void ReturnPooledContext();
+    std::string FindShaderFile(const std::string &id) const;
 
     void SetDisableLighting() const;
     void SetShadingSamples() const;
@@ -263,12 +299,68 @@ private:
     HdNSIRenderDelegate &operator =(const HdNSIRenderDelegate &) = delete;
 
     // A shared NSI CAPI and context.
-    std::unique_ptr<NSI::DynamicAPI> _capi;
+    std::shared_ptr<NSI::DynamicAPI> _capi;
 
     std::shared_ptr<NSI::Context> _nsi;
 
     bool m_apistream_product{false};
 
+    /* Where the NSI stream goes, if the context outputs one. */
+    std::string m_stream_filename;
+    std::string m_stream_format;
+    std::string m_stream_compression;
+    /* Frames after the first go to streams of only the changes. */
+    bool m_delta_streams{false};
+    /* Temporary file of the delta stream being recorded. */
+    std::string m_delta_pending;
+    /* The product name of the last frame, before any renaming. */
+    std::string m_delta_product;
+    unsigned m_delta_count{0};
+    /* Print stream size and time when an export is done. */
+    bool m_stream_report{false};
+    std::chrono::steady_clock::time_point m_stream_start;
+
+    /* Batch frames may complete while the next one is being synced. */
+    bool m_pipelined_batch{false};
+
+    /* Prims drop their copy of exported data in batch renders. */
+    bool m_lean_batch{false};
+    /* Memory released that way since the last report. */
+    std::atomic<size_t> m_released_bytes{0};
+    /* Released data which edited prims had to fetch again. */
+    std::atomic<size_t> m_refetched_bytes{0};
+
+    /* Saves the progress of batch renders, when enabled. */
+    std::unique_ptr<HdNSICheckpoint> m_checkpoint;
+
+    /* Exported geometry reused across sessions, when enabled. */
+    std::unique_ptr<HdNSIGeometryCache> m_geometry_cache;
+
+    /* Renders batch frames with worker processes, when enabled. */
+    std::unique_ptr<HdNSIDistributedRender> m_distributed;
+
+    /* Smooth normals computed in the background, when enabled. */
+    std::unique_ptr<HdNSIAsyncNormals> m_async_normals;
+
+    /* Geometry nodes of identical meshes, when automatic instancing is on. */
+    std::unique_ptr<HdNSISharedShapes> m_shared_shapes;
+
+    /* Performance numbers of batch frames, when enabled. */
+    std::unique_ptr<HdNSIFrameReport> m_frame_report;
+
+    /*
+        Primvars exported even when no material reads them. Null when all
+        primvars are exported, which is the default.
+    */
+    std::shared_ptr<const TfToken::Set> m_kept_primvars;
+    /* The primvars read by the default material, plus the above. */
+    std::shared_ptr<const TfToken::Set> m_default_material_primvars;
+
+    /* The context goes back to a pool for the next delegate when done. */
+    bool m_service{false};
+    /* Identifies which pooled contexts this delegate can use. */
+    std::string m_service_key;
+
     // A shared HdNSIRenderParam object that stores top-level NSI state;
     // passed to prims during Sync().
     std::shared_ptr<HdNSIRenderParam> _renderParam;
@@ -26,14 +26,23 @@
 #ifndef HDNSI_RENDER_PARAM_H
 #define HDNSI_RENDER_PARAM_H
 
+#include "commandBuffer.h"
+#include "frameReport.h"
+#include "motionSamples.h"
 #include "renderDelegate.h"
 
 #include <pxr/pxr.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/fileUtils.h>
 
 #include <nsi_dynamic.hpp>
 
 #include <atomic>
 #include <cassert>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
@@ -60,15 +69,90 @@ public:
 
 	HdNSIRenderDelegate* GetRenderDelegate() const { return _renderDelegate; }
 
-	/// Accessor for the top-level NSI scene.
+	/*
+		Accessor for the top-level NSI scene. While a render left running by
+		DeferWait() is pending, this is a context recording the edits instead.
+	*/
 	NSI::Context& AcquireSceneForEdit()
 	{
 		_sceneEdited.store(true, std::memory_order_relaxed);
+		if (_pendingWait.load(std::memory_order_acquire))
+		{
+			if (NSI::Context *recording = RecordingContext())
+			{
+				FlushDeferredDeletes(*recording);
+				return *recording;
+			}
+		}
+		FlushDeferredDeletes(*_nsi);
 		return *_nsi;
 	}
+
+	/*
+		Delete a node of the scene, when its prim is removed.
+
+		Without any render pass, this is most likely the render index being
+		destroyed along with the delegate, and ending the context removes
+		everything at once. So the deletes are only recorded then. They are
+		applied before any further edit, in case the scene is used again.
+	*/
+	void DeleteNode(const std::string &handle)
+	{
+		if (_deferDeletes)
+		{
+			std::lock_guard<std::mutex> lock(_deferredDeletesMutex);
+			_deferredDeletes.push_back(handle);
+			_hasDeferredDeletes = true;
+			return;
+		}
+		AcquireSceneForEdit().Delete(handle);
+	}
+
+	void SetDeferDeletes(bool defer) { _deferDeletes = defer; }
+	bool IsDeferringDeletes() const { return _deferDeletes; }
+
+	void FlushDeferredDeletes() { FlushDeferredDeletes(*_nsi); }
+	void FlushDeferredDeletes(NSI::Context &nsi)
+	{
+		if (!_hasDeferredDeletes)
+			return;
+		std::lock_guard<std::mutex> lock(_deferredDeletesMutex);
+		for (const std::string &handle : _deferredDeletes)
+		{
+			nsi.Delete(handle);
+		}
+		_deferredDeletes.clear();
+		_hasDeferredDeletes = false;
+	}
 	/// Accessor for the global shared NSI context.
 	NSI::Context& GetNSIContext() { return *_nsi; }
 
+	/*
+		The buffer in which prims record their attribute edits of a context,
+		if it is the scene's or records edits for it. Other contexts (eg. a
+		geometry cache entry) must be edited directly.
+	*/
+	HdNSICommandBuffer* GetCommandBuffer(const NSI::Context &nsi)
+	{
+		if (&nsi == _nsi.get())
+			return &_commandBuffer;
+		std::lock_guard<std::mutex> lock(_pendingWaitMutex);
+		return &nsi == _recording.get() ? &_commandBuffer : nullptr;
+	}
+
+	/* Shutter and settings for the motion samples of prims. */
+	HdNSIMotionSamples& GetMotionSamples() { return _motionSamples; }
+
+	/*
+		Send what prims recorded in the command buffer. This first waits for
+		a pending render, so the recorded edits are in the scene.
+	*/
+	void FlushCommands()
+	{
+		FinishPendingRender();
+		_commandBuffer.Flush(*_nsi);
+	}
+
 	bool SceneEdited() const { return _sceneEdited; }
 	void ResetSceneEdited() { _sceneEdited = false; }
 
@@ -86,14 +170,15 @@ public:
 		assert(!_rendering);
 		GetNSIContext().RenderControl(NSI::CStringPArg("action", "start"));
 		_isConverged = true;
-		/* Reset the context so the Delete calls don't get exported. */
-		GetNSIContext().Begin();
+		_renderDelegate->StreamExported();
 	}
 
 	void StartRender(bool batch)
 	{
 		assert(!_rendering);
 		_rendering = true;
+		if (auto report = _renderDelegate->GetFrameReport())
+			report->RenderStarted();
 		GetNSIContext().RenderControl((
 			NSI::CStringPArg("action", "start"),
 			NSI::PointerArg("stoppedcallback", (void*)StatusCB),
@@ -108,6 +193,48 @@ public:
 		GetNSIContext().RenderControl(NSI::CStringPArg("action", "wait"));
 		//Rendering already finished here so we set _rendering to false.
 		_rendering = false;
+		if (auto report = _renderDelegate->GetFrameReport())
+			report->RenderEnded();
+	}
+
+	/*
+		Leave a batch render running after the frame has been handed back to
+		Hydra, so writing its image files overlaps with the sync of the next
+		frame. The renderer can't take edits of the scene while it renders a
+		batch frame. So until the render is waited for, edits are recorded
+		to a stream (see AcquireSceneForEdit()) which is then evaluated into
+		the scene. That happens when the prims are all synced, in
+		FlushCommands(), or before anything else needs the render done.
+	*/
+	void DeferWait()
+	{
+		_pendingWait.store(true, std::memory_order_release);
+	}
+
+	/*
+		Wait for a render left running by DeferWait() and apply the edits
+		recorded meanwhile. Thread safe.
+	*/
+	void FinishPendingRender()
+	{
+		if (!_pendingWait.load(std::memory_order_acquire))
+			return;
+
+		std::lock_guard<std::mutex> lock(_pendingWaitMutex);
+		if (_pendingWait.load(std::memory_order_relaxed))
+		{
+			Wait();
+			_pendingWait.store(false, std::memory_order_release);
+			if (_recording)
+			{
+				_recording->End();
+				_recording.reset();
+				_nsi->Evaluate((
+					NSI::StringArg("type", "apistream"),
+					NSI::StringArg("filename", _recordingFile)));
+				TfDeleteFile(_recordingFile);
+			}
+		}
 	}
 
 	void StopRender()
@@ -134,6 +261,23 @@ public:
 	}
 
 private:
+	/* The context recording edits while a render is pending, or null. */
+	NSI::Context* RecordingContext()
+	{
+		std::lock_guard<std::mutex> lock(_pendingWaitMutex);
+		if (!_pendingWait.load(std::memory_order_relaxed))
+			return nullptr;
+		if (!_recording)
+		{
+			_recordingFile = ArchMakeTmpFileName("hdnsi_edits", ".nsib");
+			_recording.reset(new NSI::Context(_renderDelegate->GetAPI()));
+			_recording->Begin((
+				NSI::StringArg("streamfilename", _recordingFile),
+				NSI::StringArg("streamformat", "binarynsi")));
+		}
+		return _recording.get();
+	}
+
 	static void StatusCB(void *data, NSIContext_t ctx, int status)
 	{
 		auto param = (HdNSIRenderParam*)data;
@@ -178,6 +322,25 @@ private:
 
 	/// Number of lights in the scene.
 	std::atomic<unsigned> _numLights;
+
+	/// true when a finished batch frame has not been waited for yet.
+	std::atomic<bool> _pendingWait{false};
+	std::mutex _pendingWaitMutex;
+	/// Edits made meanwhile, and the stream file they are recorded to.
+	std::unique_ptr<NSI::Context> _recording;
+	std::string _recordingFile;
+
+	/// Attribute edits recorded during sync. See GetCommandBuffer().
+	HdNSICommandBuffer _commandBuffer;
+
+	/// Motion samples preparation, shared by all prims.
+	HdNSIMotionSamples _motionSamples;
+
+	/// true while there is no render pass. See DeleteNode().
+	std::atomic<bool> _deferDeletes{true};
+	std::atomic<bool> _hasDeferredDeletes{false};
+	std::vector<std::string> _deferredDeletes;
+	std::mutex _deferredDeletesMutex;
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
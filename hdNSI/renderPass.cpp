@@ -26,7 +26,13 @@
 
 #include "renderPass.h"
 
+#include "asyncNormals.h"
 #include "camera.h"
+#include "checkpoint.h"
+#ifdef ENABLE_DISTRIBUTED
+#	include "distributedRender.h"
+#endif
+#include "frameReport.h"
 #include "mesh.h"
 #include "renderDelegate.h"
 #include "renderParam.h"
@@ -41,6 +47,7 @@
 #include <pxr/usd/usdRender/tokens.h>
 
 #include <atomic>
+#include <cstring>
 
 PXR_NAMESPACE_OPEN_SCOPE
 
@@ -94,6 +101,24 @@ VtValue GetHashMapEntry(const TokenValueMap &map, const TfToken &name)
 		return {};
 	return it->second;
 }
+
+/*
+	Returns the render products without their names. When this does not change,
+	the products can be updated in place by renaming their output files.
+*/
+std::vector<TokenValueMap> ProductsLayout(const VtValue &products_val)
+{
+	std::vector<TokenValueMap> layout;
+	if( !products_val.IsHolding<VtArray<TokenValueMap>>() )
+		return layout;
+
+	for( const TokenValueMap &prod : products_val.Get<VtArray<TokenValueMap>>() )
+	{
+		layout.push_back(prod);
+		layout.back().erase(_tokens->productName);
+	}
+	return layout;
+}
 }
 
 HdNSIRenderPass::HdNSIRenderPass(
@@ -121,6 +146,9 @@ HdNSIRenderPass::HdNSIRenderPass(
 
 HdNSIRenderPass::~HdNSIRenderPass()
 {
+	/* Let a pipelined frame complete instead of aborting it below. */
+	_renderParam->FinishPendingRender();
+
 #if defined(PXR_VERSION) && PXR_VERSION <= 2111
 	/* Delete the placeholder cam if one was used. */
 	if (m_placeholder_camera)
@@ -136,10 +164,54 @@ HdNSIRenderPass::~HdNSIRenderPass()
 		_renderParam->StopRender();
 		_renderParam->Wait();
 	}
+
+	/*
+		Delete everything the pass exported. The context may outlive it, in
+		service mode or for another pass, and the output layers point into
+		the OutputLayer objects freed with us.
+	*/
+	NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
+	for( const auto &p : m_outputs )
+	{
+		nsi.Delete(p->driverHandle);
+		nsi.Delete(p->layerHandle);
+	}
+	m_outputs.clear();
+	m_retired_outputs.clear();
+	for( const std::string &handle : _productNodes )
+	{
+		nsi.Delete(handle);
+	}
+	_productNodes.clear();
+	m_product_drivers.clear();
+	for( const auto &extra : m_extra_cameras )
+	{
+		extra->data.Delete(_renderParam);
+	}
+	m_extra_cameras.clear();
+	if( !m_headlight_xform.empty() )
+	{
+		nsi.Delete(Handle("|headlight|geo"));
+		nsi.Delete(Handle("|headlight|attr"));
+	}
+	/* Disabling the headlight leaves its shader. */
+	nsi.Delete(Handle("|headlight|shader"));
+	if( m_screen_created )
+	{
+		nsi.Delete(ScreenHandle());
+	}
+	m_render_camera.Delete(_renderParam);
+
+	_renderDelegate->RemoveRenderPass(this);
 }
 
 bool HdNSIRenderPass::IsConverged() const
 {
+	/* Hydra must keep going until background normals are sent. */
+	HdNSIAsyncNormals *async = _renderDelegate->GetAsyncNormals();
+	bool converged = _renderParam->IsConverged() &&
+		!(async && async->IsPending());
+
 	/*
 		Propagate converged flag to all the render buffers. It's a little weird
 		to do this here but it works.
@@ -147,9 +219,9 @@ bool HdNSIRenderPass::IsConverged() const
 	for( const auto &b : _aovBindings )
 	{
 		static_cast<HdNSIRenderBuffer*>(b.renderBuffer)->SetConverged(
-			_renderParam->IsConverged());
+			converged);
 	}
-	return _renderParam->IsConverged();
+	return converged;
 }
 
 void HdNSIRenderPass::RenderSettingChanged(const TfToken &key)
@@ -163,6 +235,11 @@ void HdNSIRenderPass::RenderSettingChanged(const TfToken &key)
 		if (!m_headlight_xform.empty())
 			ExportNSIHeadLightShader();
 	}
+	if (key == _tokens->delegateRenderProducts)
+	{
+		if (!_productNodes.empty())
+			UpdateRenderProducts();
+	}
 }
 
 /*
@@ -213,6 +290,9 @@ void HdNSIRenderPass::_Execute(
 	HdRenderPassStateSharedPtr const& renderPassState,
 	TfTokenVector const &renderTags)
 {
+	/* The previous frame must be done if nothing was edited since. */
+	_renderParam->FinishPendingRender();
+
 	GfVec4f vp = renderPassState->GetViewport();
 	auto *camera = static_cast<const HdNSICamera*>(
 		renderPassState->GetCamera());
@@ -265,12 +345,13 @@ void HdNSIRenderPass::_Execute(
 	{
 		UpdateScreen(*renderPassState, camera);
 	}
+	m_camera_id = camera->GetId();
 
 	// If the list of AOVs changed, update the outputs.
 	HdRenderPassAovBindingVector aovBindings =
 		renderPassState->GetAovBindings();
 
-	if( _outputNodes.empty() || aovBindings != _aovBindings )
+	if( m_outputs.empty() || aovBindings != _aovBindings )
 	{
 		_aovBindings = aovBindings;
 #if defined(PXR_VERSION) && PXR_VERSION <= 2002
@@ -289,12 +370,34 @@ void HdNSIRenderPass::_Execute(
 			aovBindings.push_back(aov);
 		}
 #endif
-		/* Output changes required stopping the render. */
-		_renderParam->StopRender();
+		/*
+			Only the layers which were actually added or removed are edited so
+			this usually does not require stopping the render. The changes are
+			pushed to the renderer below, like any other scene edit.
+		*/
 		UpdateOutputs(aovBindings);
-		ExportRenderProducts();
+		if( _productNodes.empty() )
+		{
+			ExportRenderProducts();
+		}
+
+		/* Switch to or from the quick picking mode. */
+		bool id_render = !aovBindings.empty() && _productNodes.empty();
+		for( const HdRenderPassAovBinding &aov : aovBindings )
+		{
+			id_render = id_render && IsIdOnlyAov(aov.aovName);
+		}
+		if( id_render != m_id_render )
+		{
+			m_id_render = id_render;
+			SetOversampling();
+			_renderDelegate->IdRenderChanged();
+		}
 	}
 
+	/* Follow the cameras of render products which don't use ours. */
+	UpdateExtraCameras();
+
 	/* Apply render tags if needed. */
 	UpdateRenderTags(renderTags);
 
@@ -303,13 +406,26 @@ void HdNSIRenderPass::_Execute(
 	_depthProj.M22 = projMatrix[2][2];
 	_depthProj.M32 = projMatrix[3][2];
 
-	/* Enable headlight if there are no lights in the scene. */
-	UpdateHeadlight(!_renderParam->HasLights(), camera);
+	/* Enable headlight if there are no lights in the scene. Id renders have
+	   no use for it. */
+	UpdateHeadlight(!_renderParam->HasLights() && !m_id_render, camera);
 
 	if (_renderDelegate->HasAPIStreamProduct())
 	{
 		_renderParam->DoStreamExport();
 	}
+#ifdef ENABLE_DISTRIBUTED
+	else if (_renderDelegate->GetDistributedRender())
+	{
+		RenderDistributed(*_renderDelegate->GetDistributedRender());
+	}
+#endif
+	else if (_renderDelegate->IsBatch() && _renderDelegate->GetCheckpoint() &&
+	         !m_outputs.empty() && _productNodes.empty())
+	{
+		/* Only raster outputs can be checkpointed. */
+		RenderBatchWithCheckpoint(*_renderDelegate->GetCheckpoint());
+	}
 	else if (!_renderParam->IsRendering())
 	{
 		/* Start (or restart) rendering. */
@@ -318,19 +434,46 @@ void HdNSIRenderPass::_Execute(
 		//If rendering started in batch mode, wait for it to finish.
 		if (_renderDelegate->IsBatch())
 		{
-			_renderParam->Wait();
+			/*
+				Unless all the outputs are files written by the renderer. Then
+				the frame can be finished while Hydra moves on to the next one.
+				Raster outputs still need to be filled before we return.
+			*/
+			if (_renderDelegate->IsPipelinedBatch() && m_outputs.empty())
+			{
+				_renderParam->DeferWait();
+				_renderParam->SetConverged();
+			}
+			else
+			{
+				_renderParam->Wait();
+			}
 		}
 	}
 	else if (_renderParam->SceneEdited())
 	{
 		/* Push all changes to the scene. */
 		_renderParam->SyncRender();
+		/*
+			The removed outputs' drivers are closed once that completes, later.
+			m_retired_outputs is only cleared when the render is stopped.
+		*/
+	}
+
+	/* A pipelined frame's record is completed when its render is waited for. */
+	if (HdNSIFrameReport *report = _renderDelegate->GetFrameReport())
+	{
+		report->FrameDone(ProductNames());
 	}
 
 	/* The renderer is now up to date on all changes. */
 	_renderParam->ResetSceneEdited();
 	/* The camera has been hooked up everywhere. */
 	m_render_camera.SetUsed();
+	for( const auto &extra : m_extra_cameras )
+	{
+		extra->data.SetUsed();
+	}
 
 #if defined(PXR_VERSION) && PXR_VERSION <= 2002
 	// Blit, only when no AOVs are specified.
@@ -350,62 +493,221 @@ void HdNSIRenderPass::_Execute(
 #endif
 }
 
+/*
+	Bring the output layers in line with a new list of AOV bindings.
+
+	Outputs are matched with the previous ones by AOV name, settings and buffer
+	format. Those which match are kept as they are and only get retargeted to
+	the new render buffer, if it changed. Only the outputs which are actually
+	new or gone are created or deleted.
+*/
 void HdNSIRenderPass::UpdateOutputs(
 	const HdRenderPassAovBindingVector &bindings)
 {
-	NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
+	/* Some edits can't be applied to a running render. */
+	if( _renderParam->IsRendering() && OutputsNeedRestart(bindings) )
+	{
+		_renderParam->StopRender();
+	}
 
-	/* Delete the NSI nodes from the previous output specification. */
-	for( const std::string &h : _outputNodes )
+	/* Nothing can reference removed outputs once rendering has stopped. */
+	if( !_renderParam->IsRendering() )
 	{
-		nsi.Delete(h);
+		m_retired_outputs.clear();
 	}
-	_outputNodes.clear();
+
+	std::vector<std::unique_ptr<OutputLayer>> previous;
+	previous.swap(m_outputs);
 
 	int i = 0;
 	for( const HdRenderPassAovBinding &aov : bindings )
 	{
-		/* Create an output layer. */
-		std::string layerHandle = Handle("|outputLayer") + std::to_string(i);
-		nsi.Create(layerHandle, "outputlayer");
-		nsi.SetAttribute(layerHandle, NSI::IntegerArg("sortkey", i));
+		auto renderBuffer = static_cast<HdNSIRenderBuffer*>(aov.renderBuffer);
 
+		/* Look for an existing output which produces the same thing. */
+		std::unique_ptr<OutputLayer> layer;
+		for( auto &p : previous )
+		{
+			if( p &&
+			    p->aovName == aov.aovName &&
+			    p->aovSettings == aov.aovSettings &&
+			    p->format == renderBuffer->GetFormat() )
+			{
+				layer = std::move(p);
+				break;
+			}
+		}
+
+		if( layer )
+		{
+			RetargetOutputLayer(*layer, renderBuffer);
+			if( layer->sortkey != i )
+			{
+				layer->sortkey = i;
+				_renderParam->AcquireSceneForEdit().SetAttribute(
+					layer->layerHandle, NSI::IntegerArg("sortkey", i));
+			}
+		}
+		else
+		{
+			layer = CreateOutputLayer(
+				_renderParam->AcquireSceneForEdit(), aov, i);
+		}
+		m_outputs.push_back(std::move(layer));
+
+		++i;
+	}
+
+	/* Delete the outputs which are no longer bound. */
+	for( auto &p : previous )
+	{
+		if( !p )
+			continue;
+
+		NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
+		nsi.Delete(p->driverHandle);
+		nsi.Delete(p->layerHandle);
+		/* An open output driver may still write through the slot. */
+		p->buffer.store(nullptr);
+		m_retired_outputs.push_back(std::move(p));
+	}
+}
+
+/*
+	Tell if new AOV bindings change outputs in a way a running render can't
+	follow: an AOV which stays bound but with other settings (eg. its filter)
+	or format, or which is moved to a buffer of another resolution. Outputs
+	which are only added, removed or moved to a similar buffer are edited
+	live.
+*/
+bool HdNSIRenderPass::OutputsNeedRestart(
+	const HdRenderPassAovBindingVector &bindings) const
+{
+	for( const HdRenderPassAovBinding &aov : bindings )
+	{
 		auto renderBuffer = static_cast<HdNSIRenderBuffer*>(aov.renderBuffer);
-		/* The output driver will retrieve this pointer to access the buffer. */
-		nsi.SetAttribute(layerHandle, NSI::PointerArg("buffer", renderBuffer));
-		/* Set format to match the buffer. */
-		SetFormatNSILayerAttributes(
-			nsi, layerHandle, renderBuffer->GetFormat(), nullptr);
-		/* Set what to produce from raw source or builtin Hydra AOV. */
-		if( !SetRawSourceNSILayerAttributes(nsi, layerHandle, aov.aovSettings) )
+		const OutputLayer *same = nullptr;
+		bool same_name = false;
+		for( const auto &p : m_outputs )
 		{
-			renderBuffer->SetBindingNSILayerAttributes(nsi, layerHandle, aov);
+			if( p->aovName != aov.aovName )
+				continue;
+			same_name = true;
+			if( p->aovSettings == aov.aovSettings &&
+			    p->format == renderBuffer->GetFormat() )
+			{
+				same = p.get();
+				break;
+			}
 		}
 
-		if( aov.aovName == HdAovTokens->depth )
+		if( !same )
 		{
-			/* Depth AOV needs extra data for the projection. */
-			nsi.SetAttribute(layerHandle,
-				NSI::PointerArg("projectdepth", &_depthProj));
+			if( same_name )
+				return true;
+			continue;
 		}
 
-		/* Create an output driver. */
-		std::string driverHandle = Handle("|outputDriver") + std::to_string(i);
-		nsi.Create(driverHandle, "outputdriver");
-		nsi.SetAttribute(driverHandle, (
-			NSI::StringArg("drivername", "HdNSI"),
-			NSI::StringArg("imagefilename", aov.aovName.GetString())));
+		HdNSIRenderBuffer *previous = same->buffer.load();
+		if( previous && previous != renderBuffer &&
+		    (previous->GetWidth() != renderBuffer->GetWidth() ||
+		     previous->GetHeight() != renderBuffer->GetHeight()) )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+std::unique_ptr<HdNSIRenderPass::OutputLayer>
+HdNSIRenderPass::CreateOutputLayer(
+	NSI::Context &nsi,
+	const HdRenderPassAovBinding &aov,
+	int sortkey)
+{
+	auto renderBuffer = static_cast<HdNSIRenderBuffer*>(aov.renderBuffer);
+
+	std::unique_ptr<OutputLayer> layer{new OutputLayer};
+	layer->aovName = aov.aovName;
+	layer->aovSettings = aov.aovSettings;
+	layer->format = renderBuffer->GetFormat();
+	layer->sortkey = sortkey;
+	layer->buffer.store(renderBuffer);
+
+	std::string suffix = std::to_string(++m_output_counter);
+	layer->layerHandle = Handle("|outputLayer") + suffix;
+	layer->driverHandle = Handle("|outputDriver") + suffix;
+	const std::string &layerHandle = layer->layerHandle;
+	const std::string &driverHandle = layer->driverHandle;
+
+	/* Create an output layer. */
+	nsi.Create(layerHandle, "outputlayer");
+	nsi.SetAttribute(layerHandle, NSI::IntegerArg("sortkey", sortkey));
+
+	/* The output driver will retrieve this pointer to access the buffer. */
+	nsi.SetAttribute(layerHandle, NSI::PointerArg("buffer", &layer->buffer));
+	/* Set format to match the buffer. */
+	SetFormatNSILayerAttributes(
+		nsi, layerHandle, renderBuffer->GetFormat(), nullptr);
+	/* Set what to produce from raw source or builtin Hydra AOV. */
+	if( !SetRawSourceNSILayerAttributes(nsi, layerHandle, aov.aovSettings) )
+	{
+		renderBuffer->SetBindingNSILayerAttributes(nsi, layerHandle, aov);
+	}
+
+	if( aov.aovName == HdAovTokens->depth )
+	{
+		/* Depth AOV needs extra data for the projection. */
+		nsi.SetAttribute(layerHandle,
+			NSI::PointerArg("projectdepth", &_depthProj));
+	}
 
-		/* Connect everything together. */
-		nsi.Connect(driverHandle, "", layerHandle, "outputdrivers");
-		nsi.Connect(layerHandle, "", ScreenHandle(), "outputlayers");
+	/* Create an output driver. */
+	nsi.Create(driverHandle, "outputdriver");
+	nsi.SetAttribute(driverHandle, (
+		NSI::StringArg("drivername", "HdNSI"),
+		NSI::StringArg("imagefilename", aov.aovName.GetString())));
 
-		/* Record the nodes so we can delete them on the next update. */
-		_outputNodes.push_back(layerHandle);
-		_outputNodes.push_back(driverHandle);
+	/* Connect everything together. */
+	nsi.Connect(driverHandle, "", layerHandle, "outputdrivers");
+	nsi.Connect(layerHandle, "", ScreenHandle(), "outputlayers");
 
-		++i;
+	return layer;
+}
+
+/*
+	Point an existing output at a different render buffer.
+
+	If a render is running, the previous buffer is still alive (deleting or
+	reallocating a buffer stops the render) so its content is carried over.
+	Otherwise the new buffer would miss the parts of the image which were
+	already produced. The renderer may still write to the previous buffer
+	during the copy, so a bucket can tear. That is accepted: it is only a
+	progressive image and the next pass over the bucket replaces it.
+*/
+void HdNSIRenderPass::RetargetOutputLayer(
+	OutputLayer &layer,
+	HdNSIRenderBuffer *renderBuffer)
+{
+	HdNSIRenderBuffer *previous = layer.buffer.load();
+	if( previous == renderBuffer )
+		return;
+
+	if( previous && _renderParam->IsRendering() &&
+	    previous->GetWidth() == renderBuffer->GetWidth() &&
+	    previous->GetHeight() == renderBuffer->GetHeight() &&
+	    previous->GetFormat() == renderBuffer->GetFormat() )
+	{
+		size_t size = renderBuffer->GetWidth() * renderBuffer->GetHeight() *
+			HdDataSizeOfFormat(renderBuffer->GetFormat());
+		void *dst = renderBuffer->Map();
+		const void *src = previous->Map();
+		memcpy(dst, src, size);
+		previous->Unmap();
+		renderBuffer->Unmap();
 	}
+
+	layer.buffer.store(renderBuffer);
 }
 
 /*
@@ -424,9 +726,11 @@ void HdNSIRenderPass::ExportRenderProducts()
 
 	NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
 	const auto &products = products_val.Get<VtArray<TokenValueMap>>();
+	m_products_layout = ProductsLayout(products_val);
 	int i = 0;
-	for( const HdRenderSettingsMap &prod : products )
+	for( size_t p = 0; p < products.size(); ++p )
 	{
+		const HdRenderSettingsMap &prod = products[p];
 		VtValue productName_val = GetHashMapEntry(prod, _tokens->productName);
 		VtValue productType_val = GetHashMapEntry(prod, _tokens->productType);
 		VtValue orderedVars_val = GetHashMapEntry(prod, _tokens->orderedVars);
@@ -494,6 +798,9 @@ void HdNSIRenderPass::ExportRenderProducts()
 		else
 			continue; /* ignore unknown and nsi:apistream */
 
+		/* Products may render another camera than the pass' own. */
+		const std::string productScreen = ProductScreen(prod);
+
 		/* Create a single output driver for all the layers of a product. */
 		std::string driverHandle =
 			Handle("|productOutputDriver") + std::to_string(i);
@@ -501,8 +808,8 @@ void HdNSIRenderPass::ExportRenderProducts()
 		nsi.SetAttribute(driverHandle, (
 			NSI::StringArg("drivername", drivername),
 			NSI::StringArg("imagefilename", productName.GetString())));
-		/* Record those even if there shouldn't be updates for now. */
-		_outputNodes.push_back(driverHandle);
+		_productNodes.push_back(driverHandle);
+		m_product_drivers.emplace_back(p, driverHandle);
 
 		for( const HdAovDescriptor &desc : descriptors )
 		{
@@ -519,16 +826,62 @@ void HdNSIRenderPass::ExportRenderProducts()
 
 			/* Connect with output driver and screen. */
 			nsi.Connect(driverHandle, "", layerHandle, "outputdrivers");
-			nsi.Connect(layerHandle, "", ScreenHandle(), "outputlayers");
+			nsi.Connect(layerHandle, "", productScreen, "outputlayers");
 
-			/* Record those even if there shouldn't be updates for now. */
-			_outputNodes.push_back(layerHandle);
+			_productNodes.push_back(layerHandle);
 
 			++i;
 		}
 	}
 }
 
+/*
+	Apply a change of the render products.
+
+	When rendering a sequence, husk keeps the delegate and sends the products
+	again for each frame, usually with only the file names changed. The scene
+	itself is updated by Hydra with just the prims which depend on time. So
+	renaming the output files is all that's needed here, and the next frame
+	renders from the same NSI context. Anything else rebuilds the products.
+*/
+void HdNSIRenderPass::UpdateRenderProducts()
+{
+	VtValue products_val = _renderDelegate->GetRenderSetting(
+		_tokens->delegateRenderProducts);
+
+	if( ProductsLayout(products_val) == m_products_layout )
+	{
+		NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
+		const auto &products = products_val.Get<VtArray<TokenValueMap>>();
+		for( const auto &driver : m_product_drivers )
+		{
+			VtValue productName_val = GetHashMapEntry(
+				products[driver.first], _tokens->productName);
+			if( !productName_val.IsHolding<TfToken>() )
+				continue;
+			nsi.SetAttribute(driver.second, NSI::StringArg(
+				"imagefilename", productName_val.Get<TfToken>().GetString()));
+		}
+		return;
+	}
+
+	_renderParam->StopRender();
+	NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
+	for( const std::string &handle : _productNodes )
+	{
+		nsi.Delete(handle);
+	}
+	_productNodes.clear();
+	m_product_drivers.clear();
+	for( const auto &extra : m_extra_cameras )
+	{
+		extra->data.Delete(_renderParam);
+	}
+	m_extra_cameras.clear();
+
+	ExportRenderProducts();
+}
+
 /*
 	This handles UsdRenderVar defined from Houdini for offline rendering.
 	Normally not used for a regular Hydra viewer.
@@ -742,11 +1095,239 @@ void HdNSIRenderPass::SetOversampling() const
 
 	VtValue s = _renderDelegate->GetRenderSetting(
 		HdNSIRenderSettingsTokens->pixelSamples);
+	/* Ids are not filtered so a single sample is all they need. */
+	int oversampling = m_id_render ? 1 : s.Get<int>();
 
 	_renderParam->StopRender();
 
 	nsi.SetAttribute(ScreenHandle(),
+		NSI::IntegerArg("oversampling", oversampling));
+	for( const auto &extra : m_extra_cameras )
+	{
+		nsi.SetAttribute(extra->screenHandle,
+			NSI::IntegerArg("oversampling", oversampling));
+	}
+}
+
+bool HdNSIRenderPass::IsIdOnlyAov(const TfToken &aovName)
+{
+	return
+		aovName == HdAovTokens->primId ||
+		aovName == HdAovTokens->instanceId ||
+		aovName == HdAovTokens->elementId;
+}
+
+/*
+	Do a batch render, saving its progress as it goes and resuming from the
+	last saved progress of the same frame, if there is one.
+*/
+void HdNSIRenderPass::RenderBatchWithCheckpoint(HdNSICheckpoint &checkpoint)
+{
+	std::vector<HdNSIRenderBuffer*> buffers;
+	std::string description = m_camera_id.GetString();
+	description += TfStringPrintf(" %ux%u", _width, _height);
+	for( const auto &output : m_outputs )
+	{
+		buffers.push_back(output->buffer.load());
+		description += ' ' + output->aovName.GetString();
+	}
+	/* Products have the frame in their name, when rendering a sequence. */
+	for( const std::string &name : ProductNames() )
+	{
+		description += ' ' + name;
+	}
+	size_t key = checkpoint.ComputeKey(description);
+
+	unsigned rows = checkpoint.Restore(key, buffers);
+	if( rows > 0 && rows < _height )
+	{
+		/* Render only what's left. */
+		float crop[2][2] =
+			{ { 0.0f, float(rows) / float(_height) }, { 1.0f, 1.0f } };
+		NSI::ArgumentList args;
+		args.Add(NSI::Argument::New("crop")
+			->SetArrayType(NSITypeFloat, 2)
+			->SetCount(2)
+			->CopyValue(crop, sizeof(crop)));
+		_renderParam->AcquireSceneForEdit().SetAttribute(ScreenHandle(), args);
+	}
+
+	checkpoint.Begin(key, buffers);
+	if( rows < _height )
+	{
+		_renderParam->StartRender(true);
+		_renderParam->Wait();
+	}
+	/* This removes the checkpoint. A killed render never gets here. */
+	checkpoint.End(true);
+	_renderParam->SetConverged();
+
+	if( rows > 0 )
+	{
+		_renderParam->AcquireSceneForEdit().DeleteAttribute(
+			ScreenHandle(), "crop");
+	}
+}
+
+/* The names of the delegate render products, which are usually files. */
+std::vector<std::string> HdNSIRenderPass::ProductNames() const
+{
+	std::vector<std::string> names;
+	VtValue products_val = _renderDelegate->GetRenderSetting(
+		_tokens->delegateRenderProducts);
+	if( products_val.IsHolding<VtArray<TokenValueMap>>() )
+	{
+		for( const auto &prod : products_val.Get<VtArray<TokenValueMap>>() )
+		{
+			VtValue name = GetHashMapEntry(prod, _tokens->productName);
+			if( name.IsHolding<TfToken>() )
+				names.push_back(name.Get<TfToken>().GetString());
+		}
+	}
+	return names;
+}
+
+#ifdef ENABLE_DISTRIBUTED
+/*
+	Render a batch frame with worker processes. The context only streams the
+	scene so nothing is rendered here. Each raster output gets its image back
+	from the workers.
+*/
+void HdNSIRenderPass::RenderDistributed(HdNSIDistributedRender &distributed)
+{
+	std::vector<HdNSIDistributedRender::Output> outputs;
+	for( const auto &output : m_outputs )
+	{
+		HdNSIRenderBuffer *buffer = output->buffer.load();
+		if( !buffer )
+			continue;
+		outputs.push_back({output->driverHandle, buffer,
+			output->aovName == HdAovTokens->depth ? &_depthProj : nullptr});
+	}
+
+	/* Each worker would write its own part over the same file. */
+	if( !_productNodes.empty() )
+	{
+		TF_WARN("Render products are not written by distributed renders");
+	}
+
+	_renderDelegate->EndSceneSegment();
+	distributed.Render(
+		ScreenHandle(), outputs, _productNodes, _width, _height);
+	_renderParam->SetConverged();
+}
+#endif
+
+/*
+	Returns the handle of the screen a render product's layers should be
+	connected to. This is our main screen unless the product names a camera
+	other than the one we render with, in which case a screen is created for
+	that camera. All of them render the same scene in a single pass, which is
+	how stereo pairs or camera arrays avoid translating the scene again.
+*/
+std::string HdNSIRenderPass::ProductScreen(
+	const HdRenderSettingsMap &product)
+{
+	VtValue camera_val = GetHashMapEntry(product, UsdRenderTokens->camera);
+	SdfPath camera_id;
+	if( camera_val.IsHolding<SdfPath>() )
+		camera_id = camera_val.Get<SdfPath>();
+	else if( camera_val.IsHolding<TfToken>() )
+		camera_id = SdfPath(camera_val.Get<TfToken>().GetString());
+	else if( camera_val.IsHolding<std::string>() )
+		camera_id = SdfPath(camera_val.Get<std::string>());
+
+	if( camera_id.IsEmpty() || camera_id == m_camera_id )
+		return ScreenHandle();
+
+	/* Reuse the screen of a product which had the same camera. */
+	for( const auto &extra : m_extra_cameras )
+	{
+		if( extra->id == camera_id )
+			return extra->screenHandle;
+	}
+
+	std::unique_ptr<ExtraCamera> extra(new ExtraCamera);
+	std::string n = std::to_string(m_extra_cameras.size() + 2);
+	extra->id = camera_id;
+	extra->data.SetId(Handle("|extraCam") + n);
+	extra->data.SetUseGlobalSettings();
+	extra->screenHandle = Handle("|screen") + n;
+
+	/* The product's own resolution wins over the global one. */
+	extra->resolution = _renderDelegate->GetRenderSetting<GfVec2i>(
+		UsdRenderTokens->resolution, GfVec2i(_width, _height));
+	VtValue res_val = GetHashMapEntry(product, UsdRenderTokens->resolution);
+	if( res_val.IsHolding<GfVec2i>() )
+		extra->resolution = res_val.Get<GfVec2i>();
+
+	extra->pixelAspect = _renderDelegate->GetRenderSetting<float>(
+		UsdRenderTokens->pixelAspectRatio, 1.0f);
+	VtValue pa_val =
+		GetHashMapEntry(product, UsdRenderTokens->pixelAspectRatio);
+	if( pa_val.IsHolding<float>() )
+		extra->pixelAspect = pa_val.Get<float>();
+
+	NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
+	nsi.Create(extra->screenHandle, "screen");
+	VtValue s = _renderDelegate->GetRenderSetting(
+		HdNSIRenderSettingsTokens->pixelSamples);
+	nsi.SetAttribute(extra->screenHandle,
 		NSI::IntegerArg("oversampling", s.Get<int>()));
+	_productNodes.push_back(extra->screenHandle);
+
+	m_extra_cameras.push_back(std::move(extra));
+	return m_extra_cameras.back()->screenHandle;
+}
+
+/*
+	Export the cameras used by the extra screens created for render products
+	and update the screens when their camera changes.
+*/
+void HdNSIRenderPass::UpdateExtraCameras()
+{
+	for( const auto &extra : m_extra_cameras )
+	{
+		auto *camera = static_cast<const HdNSICamera*>(
+			GetRenderIndex()->GetSprim(HdPrimTypeTokens->camera, extra->id));
+		if( !camera )
+		{
+			TF_WARN("Render product camera '%s' not found",
+				extra->id.GetText());
+			continue;
+		}
+
+		if( !extra->data.UpdateExportedCamera(camera->Data(), _renderParam) &&
+		    !extra->data.IsNew() )
+		{
+			continue;
+		}
+
+		NSI::Context &nsi = _renderParam->AcquireSceneForEdit();
+		if( extra->data.IsNew() )
+		{
+			nsi.Connect(
+				extra->screenHandle, "",
+				extra->data.GetCameraNode(), "screens");
+		}
+
+		NSI::ArgumentList args;
+		int res[2] = { extra->resolution[0], extra->resolution[1] };
+		args.Add(NSI::Argument::New("resolution")
+			->SetArrayType(NSITypeInteger, 2)
+			->CopyValue(res, sizeof(res)));
+
+		CameraUtilConformWindowPolicy conform_policy = ResolveConformPolicy(
+			camera->GetWindowPolicy(),
+			_renderDelegate->GetRenderSetting(
+				UsdRenderTokens->aspectRatioConformPolicy));
+
+		AddScreenWindowArgs(
+			args, extra->data, conform_policy,
+			double(res[0]) / double(res[1]), extra->pixelAspect);
+
+		nsi.SetAttribute(extra->screenHandle, args);
+	}
 }
 
 std::string HdNSIRenderPass::ExportNSIHeadLightShader()
@@ -908,41 +1489,65 @@ void HdNSIRenderPass::UpdateScreen(
 			->CopyValue(res, sizeof(res)));
 	}
 
+	CameraUtilConformWindowPolicy conform_policy = ResolveConformPolicy(
+		camera->GetWindowPolicy(),
+		_renderDelegate->GetRenderSetting(
+			UsdRenderTokens->aspectRatioConformPolicy));
+
+	AddScreenWindowArgs(
+		args, m_render_camera, conform_policy,
+		resolution_aspect, pixel_aspect);
+
+	nsi.SetAttribute(ScreenHandle(), args);
+}
+
+/*
+	If we have an aspect ratio policy from UsdRenderSettings, use that. If
+	not, use the camera's window policy. Can't the latter just be correct?
+	Certainly not. Should all the matching options be named backwards?
+	Certainly so. Does this look designed by two completely separate teams?
+	Hell yes! Hail Hydra.
+*/
+CameraUtilConformWindowPolicy HdNSIRenderPass::ResolveConformPolicy(
+	CameraUtilConformWindowPolicy camera_policy,
+	const VtValue &arcp)
+{
+	if (!arcp.IsHolding<TfToken>())
+		return camera_policy;
+
+	const TfToken rs_policy = arcp.Get<TfToken>();
+	if (rs_policy == UsdRenderTokens->expandAperture)
+		return CameraUtilFit;
+	else if (rs_policy == UsdRenderTokens->cropAperture)
+		return CameraUtilCrop;
+	else if (rs_policy == UsdRenderTokens->adjustApertureWidth)
+		return CameraUtilMatchVertically;
+	else if (rs_policy == UsdRenderTokens->adjustApertureHeight)
+		return CameraUtilMatchHorizontally;
+	else if (rs_policy == UsdRenderTokens->adjustPixelAspectRatio)
+		return CameraUtilDontConform;
+
+	TF_WARN("Unknown aspectRatioConformPolicy: %s", rs_policy.GetText());
+	return camera_policy;
+}
+
+/*
+	Add the screenwindow and pixelaspectratio attributes of a screen which
+	renders the given camera.
+*/
+void HdNSIRenderPass::AddScreenWindowArgs(
+	NSI::ArgumentList &args,
+	const HdNSICameraData &cameraData,
+	CameraUtilConformWindowPolicy conform_policy,
+	double resolution_aspect,
+	double pixel_aspect)
+{
 	/* Compute the desired image aspect ratio. */
 	double image_aspect = resolution_aspect * pixel_aspect;
 
 	/* Get camera aperture. */
-	GfRange2d ap_range = m_render_camera.GetAperture();
+	GfRange2d ap_range = cameraData.GetAperture();
 
-	/*
-		If we have an aspect ratio policy from UsdRenderSettings, use that. If
-		not, use the camera's window policy. Can't the latter just be correct?
-		Certainly not. Should all the matching options be named backwards?
-		Certainly so. Does this look designed by two completely separate teams?
-		Hell yes! Hail Hydra.
-	*/
-	CameraUtilConformWindowPolicy conform_policy = camera->GetWindowPolicy();
-	VtValue arcp = _renderDelegate->GetRenderSetting(
-		UsdRenderTokens->aspectRatioConformPolicy);
-	if (arcp.IsHolding<TfToken>())
-	{
-		const TfToken rs_policy = arcp.Get<TfToken>();
-		if (rs_policy == UsdRenderTokens->expandAperture)
-			conform_policy = CameraUtilFit;
-		else if (rs_policy == UsdRenderTokens->cropAperture)
-			conform_policy = CameraUtilCrop;
-		else if (rs_policy == UsdRenderTokens->adjustApertureWidth)
-			conform_policy = CameraUtilMatchVertically;
-		else if (rs_policy == UsdRenderTokens->adjustApertureHeight)
-			conform_policy = CameraUtilMatchHorizontally;
-		else if (rs_policy == UsdRenderTokens->adjustPixelAspectRatio)
-			conform_policy = CameraUtilDontConform;
-		else
-		{
-			TF_WARN("Unknown aspectRatioConformPolicy: %s",
-				rs_policy.GetText());
-		}
-	}
 	ap_range = CameraUtilConformedWindow(
 		ap_range, conform_policy, image_aspect);
 	auto ap_min = ap_range.GetMin();
@@ -966,8 +1571,6 @@ void HdNSIRenderPass::UpdateScreen(
 		->CopyValue(window_data, sizeof(window_data)));
 
 	args.Add(new NSI::FloatArg("pixelaspectratio", pixel_aspect));
-
-	nsi.SetAttribute(ScreenHandle(), args);
 }
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -34,6 +34,8 @@
 #include <pxr/pxr.h>
 #include <pxr/base/gf/matrix4d.h>
 #include <pxr/base/gf/range2d.h>
+#include <pxr/base/gf/vec2i.h>
+#include <pxr/imaging/cameraUtil/conformWindow.h>
 #if defined(PXR_VERSION) && PXR_VERSION >= 2102
 #include <pxr/imaging/cameraUtil/framing.h>
 #endif
@@ -50,6 +52,8 @@
 PXR_NAMESPACE_OPEN_SCOPE
 
 class HdNSICamera;
+class HdNSICheckpoint;
+class HdNSIDistributedRender;
 class HdNSIRenderDelegate;
 
 /// \class HdNSIRenderPass
@@ -81,6 +85,9 @@ public:
 
 	void RenderSettingChanged(const TfToken &key);
 
+	/* True if this pass only produces id AOVs, for picking. */
+	bool IsIdRender() const { return m_id_render; }
+
 	static void FindProducts(
 		HdNSIRenderDelegate *renderDelegate,
 		std::string &apistream_product,
@@ -104,8 +111,20 @@ protected:
 
 private:
 
+	struct OutputLayer;
+
 	void UpdateOutputs(const HdRenderPassAovBindingVector &bindings);
+	bool OutputsNeedRestart(
+		const HdRenderPassAovBindingVector &bindings) const;
+	std::unique_ptr<OutputLayer> CreateOutputLayer(
+		NSI::Context &nsi,
+		const HdRenderPassAovBinding &aov,
+		int sortkey);
+	void RetargetOutputLayer(
+		OutputLayer &layer,
+		HdNSIRenderBuffer *renderBuffer);
 	void ExportRenderProducts();
+	void UpdateRenderProducts();
 
 	bool SetRawSourceNSILayerAttributes(
 		NSI::Context &nsi,
@@ -121,6 +140,10 @@ private:
 	void UpdateRenderTags(
 		const TfTokenVector &renderTags);
 
+	void RenderBatchWithCheckpoint(HdNSICheckpoint &checkpoint);
+	std::vector<std::string> ProductNames() const;
+	void RenderDistributed(HdNSIDistributedRender &distributed);
+
 	// -----------------------------------------------------------------------
 	// Internal API
 
@@ -128,10 +151,37 @@ private:
 	// Needed by output system to get correct Z.
 	HdNSIOutputDriver::ProjData _depthProj;
 
-	// Handles to all nodes used to define outputs (layers, drivers).
-	std::vector<std::string> _outputNodes;
-
-	// AOV bindings for which the above output nodes were created.
+	/* One output layer and driver created for a Hydra AOV binding. */
+	struct OutputLayer
+	{
+		TfToken aovName;
+		HdAovSettingsMap aovSettings;
+		/* Format of the buffer the layer was created for. */
+		HdFormat format;
+		int sortkey;
+		std::string layerHandle;
+		std::string driverHandle;
+		/* The output driver reaches the bound render buffer through this. */
+		HdNSIOutputDriver::BufferSlot buffer;
+	};
+
+	// Outputs for the current AOV bindings, in binding order.
+	std::vector<std::unique_ptr<OutputLayer>> m_outputs;
+	/* Outputs removed while rendering. A running render may still reference
+	   their buffer slot, even after a synchronize, so they are kept until it
+	   stops. */
+	std::vector<std::unique_ptr<OutputLayer>> m_retired_outputs;
+	/* Used to give each output layer a unique handle. */
+	unsigned m_output_counter{0};
+
+	// Handles to all nodes used to define render products (layers, drivers).
+	std::vector<std::string> _productNodes;
+	/* Output driver of each exported product, with the product's index. */
+	std::vector<std::pair<size_t, std::string>> m_product_drivers;
+	/* The exported products, minus their names. */
+	std::vector<HdRenderSettingsMap> m_products_layout;
+
+	// AOV bindings for which the above outputs were created.
 	HdRenderPassAovBindingVector _aovBindings;
 
 #if defined(PXR_VERSION) && PXR_VERSION <= 2002
@@ -162,6 +212,9 @@ private:
 	std::string ScreenHandle() const;
 	void SetOversampling() const;
 
+	std::string ProductScreen(const HdRenderSettingsMap &product);
+	void UpdateExtraCameras();
+
 	std::string ExportNSIHeadLightShader();
 	void UpdateHeadlight(
 		bool enable,
@@ -177,9 +230,32 @@ private:
 	bool m_screen_created{false};
 	int m_screen_resolution[2] = {-1, -1};
 
+	static CameraUtilConformWindowPolicy ResolveConformPolicy(
+		CameraUtilConformWindowPolicy camera_policy,
+		const VtValue &arcp);
+	static void AddScreenWindowArgs(
+		NSI::ArgumentList &args,
+		const HdNSICameraData &cameraData,
+		CameraUtilConformWindowPolicy conform_policy,
+		double resolution_aspect,
+		double pixel_aspect);
+
 	/* The camera data we're rendering with. Exported to a separate object than
 	   all the cameras in the scene. */
 	HdNSICameraData m_render_camera;
+	/* Id of the scene camera m_render_camera currently follows. */
+	SdfPath m_camera_id;
+
+	/* A scene camera rendered by some render products, on its own screen. */
+	struct ExtraCamera
+	{
+		SdfPath id;
+		HdNSICameraData data{{}};
+		GfVec2i resolution;
+		float pixelAspect;
+		std::string screenHandle;
+	};
+	std::vector<std::unique_ptr<ExtraCamera>> m_extra_cameras;
 
 #if defined(PXR_VERSION) && PXR_VERSION <= 2111
 	/* Dummy camera used when the render pass state has no camera. */
@@ -191,6 +267,14 @@ private:
 	HdxCompositor _compositor;
 #endif
 
+	/*
+		Set when all the AOVs of this pass are ids. Such passes are rendered
+		at one sample per pixel so hosts get picking results quickly. Depth
+		or normals alone may be for display so they don't qualify.
+	*/
+	bool m_id_render{false};
+	static bool IsIdOnlyAov(const TfToken &aovName);
+
 	/* Version of currently applied render tags. */
 	unsigned m_appliedRprimRenderTags{0};
 	unsigned m_appliedTaskRenderTags{0};
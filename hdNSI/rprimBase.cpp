@@ -36,14 +36,16 @@ void HdNSIRprimBase::Sync(
 	/* The transform of the rprim itself. */
 	if (HdChangeTracker::IsTransformDirty(*dirtyBits, id))
 	{
-		ExportTransform(sceneDelegate, id, false, nsi, _xformHandle);
+		ExportTransform(sceneDelegate, id, false,
+			renderParam->GetMotionSamples(), nsi, _xformHandle);
 	}
 
-	/* Output the primId. */
+	/* Output the primId. A shared shape has it on the prim's attributes. */
 	if (HdChangeTracker::IsPrimIdDirty(*dirtyBits, id))
 	{
-		nsi.SetAttribute(_masterShapeHandle,
-			NSI::IntegerArg("primId", rprim.GetPrimId()));
+		_primId = rprim.GetPrimId();
+		nsi.SetAttribute(_shapeShared ? _attrsHandle : _masterShapeHandle,
+			NSI::IntegerArg("primId", _primId));
 	}
 
 	/* Update visibility. */
@@ -85,18 +87,63 @@ void HdNSIRprimBase::Sync(
 
 void HdNSIRprimBase::Finalize(HdNSIRenderParam *renderParam)
 {
-	NSI::Context &nsi = renderParam->AcquireSceneForEdit();
-
-	nsi.Delete(_masterShapeHandle);
+	/* A shared shape is released by the derived class. */
+	if (!_shapeShared)
+	{
+		renderParam->DeleteNode(_masterShapeHandle);
+	}
 	_masterShapeHandle.clear();
+	_shapeShared = false;
 
-	nsi.Delete(_xformHandle);
+	renderParam->DeleteNode(_xformHandle);
 	_xformHandle.clear();
 
-	nsi.Delete(_attrsHandle);
+	renderParam->DeleteNode(_attrsHandle);
 	_attrsHandle.clear();
 }
 
+/**
+	\brief Replace the prim's own geometry node by a shared one.
+
+	The per prim attributes move to the transform node, as the shape node is
+	the same for all its users. They stay there even if the prim later goes
+	back to a shape of its own. The primId goes on the attributes node.
+*/
+void HdNSIRprimBase::ShareShape(
+	NSI::Context &nsi,
+	const std::string &shared)
+{
+	/* The own node was only just created. Nothing else refers to it. */
+	nsi.Delete(_masterShapeHandle);
+	_masterShapeHandle = shared;
+	_shapeShared = true;
+	nsi.Connect(_masterShapeHandle, "", _xformHandle, "objects");
+	nsi.SetAttribute(_attrsHandle, NSI::IntegerArg("primId", _primId));
+
+	if (!_attrsOnXform)
+	{
+		_attrsOnXform = true;
+		nsi.Connect(_attrsHandle, "", _xformHandle, "geometryattributes");
+	}
+}
+
+/**
+	\brief Go back to a geometry node of the prim's own, after ShareShape().
+
+	The caller releases the shared node and exports everything again to the
+	new one.
+*/
+void HdNSIRprimBase::UnshareShape(NSI::Context &nsi)
+{
+	nsi.Disconnect(_masterShapeHandle, "", _xformHandle, "objects");
+	_masterShapeHandle = _xformHandle + "|geo";
+	_shapeShared = false;
+	nsi.Create(_masterShapeHandle, _nodeType);
+	nsi.Connect(_masterShapeHandle, "", _xformHandle, "objects");
+	nsi.DeleteAttribute(_attrsHandle, "primId");
+	nsi.SetAttribute(_masterShapeHandle, NSI::IntegerArg("primId", _primId));
+}
+
 /**
 	\brief Adjust visibility of this prim for a new list of render tags.
 */
@@ -134,6 +181,8 @@ void HdNSIRprimBase::ApplyRenderTags(
 	\param isInstancer
 		Because Hydra APIs are dumb and there is a different call to get the
 		transform of an instancer.
+	\param motion
+		Clips and reduces the samples.
 	\param nsi
 		The NSI context.
 	\param handle
@@ -143,6 +192,7 @@ void HdNSIRprimBase::ExportTransform(
 	HdSceneDelegate *sceneDelegate,
 	const SdfPath &id,
 	bool isInstancer,
+	const HdNSIMotionSamples &motion,
 	NSI::Context &nsi,
 	const std::string &handle)
 {
@@ -155,6 +205,7 @@ void HdNSIRprimBase::ExportTransform(
 	{
 		sceneDelegate->SampleTransform(id, &samples);
 	}
+	motion.ReduceTransform(samples);
 	ExportTransform(samples, nsi, handle);
 }
 
@@ -43,6 +43,13 @@ public:
 
 	const std::string& Shape() const { return _masterShapeHandle; }
 	const std::string& Attrs() const { return _attrsHandle; }
+	/* Where per prim attributes, like the material, are connected. */
+	const std::string& AttributesTarget() const
+		{ return _attrsOnXform ? _xformHandle : _masterShapeHandle; }
+
+	void ShareShape(NSI::Context &nsi, const std::string &shared);
+	void UnshareShape(NSI::Context &nsi);
+	bool IsShapeShared() const { return _shapeShared; }
 
 	void ApplyRenderTags(
 		const HdRprim &rprim,
@@ -53,6 +60,7 @@ public:
 		HdSceneDelegate *sceneDelegate,
 		const SdfPath &id,
 		bool isInstancer,
+		const HdNSIMotionSamples &motion,
 		NSI::Context &nsi,
 		const std::string &handle);
 
@@ -82,6 +90,13 @@ private:
 	std::string _masterShapeHandle;
 	std::string _xformHandle;
 	std::string _attrsHandle;
+
+	/* The shape node belongs to HdNSISharedShapes. See ShareShape(). */
+	bool _shapeShared{false};
+	/* The attributes are connected to the transform instead of the shape. */
+	bool _attrsOnXform{false};
+	/* Last exported primId, moved along with ShareShape(). */
+	int _primId{0};
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
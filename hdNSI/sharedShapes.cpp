@@ -0,0 +1,68 @@
+#include "sharedShapes.h"
+
+#include "renderParam.h"
+
+#include <pxr/base/tf/stringUtils.h>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/**
+	\brief Get the shared geometry node for some content.
+
+	\param key
+		Hash of the content. Must not be 0.
+	\param created
+		Set to true if the node was created by this call. The caller must then
+		export the content to it. Otherwise, it is exported already or is
+		being exported by another prim's sync.
+	\returns
+		The handle of the node.
+
+	The node is created while holding the lock so other prims never connect
+	it before it exists.
+*/
+std::string HdNSISharedShapes::Acquire(
+	NSI::Context &nsi,
+	size_t key,
+	const std::string &nodeType,
+	bool *created)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_handles.find(key);
+	if (it != m_handles.end())
+	{
+		++m_shapes[it->second].users;
+		*created = false;
+		return it->second;
+	}
+
+	std::string handle = TfStringPrintf("shared|%u|geo", ++m_serial);
+	nsi.Create(handle, nodeType);
+	m_handles[key] = handle;
+	m_shapes[handle] = Shape{key, 1u};
+	*created = true;
+	return handle;
+}
+
+/**
+	\brief Stop using a node returned by Acquire().
+
+	The last user deletes the node.
+*/
+void HdNSISharedShapes::Release(
+	HdNSIRenderParam *renderParam,
+	const std::string &handle)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_shapes.find(handle);
+		if (it == m_shapes.end() || --it->second.users != 0)
+			return;
+		m_handles.erase(it->second.key);
+		m_shapes.erase(it);
+	}
+	renderParam->DeleteNode(handle);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
@@ -0,0 +1,51 @@
+#ifndef HDNSI_SHAREDSHAPES_H
+#define HDNSI_SHAREDSHAPES_H
+
+#include <pxr/pxr.h>
+
+#include <nsi.hpp>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+class HdNSIRenderParam;
+
+/*
+	Geometry nodes shared by prims with identical content.
+
+	Prims find their node with a hash of everything they would export to it.
+	The first one creates the node and exports to it. The others only connect
+	it under their own transform, which makes them instances of the same
+	geometry for the renderer. The node is deleted with its last user.
+*/
+class HdNSISharedShapes
+{
+public:
+	std::string Acquire(
+		NSI::Context &nsi,
+		size_t key,
+		const std::string &nodeType,
+		bool *created);
+	void Release(HdNSIRenderParam *renderParam, const std::string &handle);
+
+private:
+	struct Shape
+	{
+		size_t key;
+		unsigned users;
+	};
+
+	std::mutex m_mutex;
+	std::unordered_map<size_t, std::string> m_handles;
+	std::unordered_map<std::string, Shape> m_shapes;
+	/* Makes handles unique, so a deferred delete never hits a new node. */
+	unsigned m_serial{0};
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
@@ -0,0 +1,310 @@
+#include "valueTypes.h"
+
+#include "primvars.h"
+
+#include <pxr/base/arch/hash.h>
+#include <pxr/imaging/hd/types.h>
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace
+{
+template <typename... T> struct TypeList {};
+
+/* Everything with an HdNSIValueType specialization, as held by a VtValue. */
+template <typename... T>
+using WithArrays = TypeList<T..., VtArray<T>...>;
+typedef WithArrays<
+	bool, int, GfVec2i, GfVec3i, GfVec4i,
+	GfHalf, float, double,
+	GfVec2h, GfVec2f, GfVec2d,
+	GfVec3h, GfVec3f, GfVec3d,
+	GfVec4h, GfVec4f, GfVec4d,
+	GfMatrix4f, GfMatrix4d,
+	TfToken, std::string, SdfAssetPath> SupportedTypes;
+
+/*
+	Call f with the value, as its held type, if that is in the list.
+
+	\returns
+		false if the type is not in the list.
+*/
+template <typename F>
+bool Dispatch(const VtValue &, F &&, TypeList<>)
+{
+	return false;
+}
+
+template <typename F, typename T, typename... Rest>
+bool Dispatch(const VtValue &value, F &&f, TypeList<T, Rest...>)
+{
+	if (value.IsHolding<T>())
+	{
+		f(value.UncheckedGet<T>());
+		return true;
+	}
+	return Dispatch(value, std::forward<F>(f), TypeList<Rest...>());
+}
+
+template <typename T>
+const T* Elements(const T &value) { return &value; }
+template <typename T>
+const T* Elements(const VtArray<T> &value) { return value.cdata(); }
+
+template <typename T>
+size_t ElementCount(const T &) { return 1; }
+template <typename T>
+size_t ElementCount(const VtArray<T> &value) { return value.size(); }
+
+/*
+	Conversion kernels. They are kept to plain loops over contiguous arrays
+	so the compiler vectorizes the numeric ones.
+*/
+template <typename From, typename To>
+void Convert(const From *__restrict in, To *__restrict out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = To(in[i]);
+}
+
+void Convert(const TfToken *in, const char **out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = in[i].GetText();
+}
+
+void Convert(const std::string *in, const char **out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = in[i].c_str();
+}
+
+void Convert(const SdfAssetPath *in, const char **out, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		out[i] = in[i].GetResolvedPath().c_str();
+}
+
+/*
+	A buffer of the calling thread for converted values, reused by the next
+	conversion. One which grew past the size of a streamed primvar is not
+	kept for long, as it could hold a lot of memory.
+*/
+template <typename T>
+T* Scratch(size_t n)
+{
+	thread_local std::vector<T> scratch;
+	if (scratch.capacity() * sizeof(T) >= HdNSIPrimvars::k_stream_bytes &&
+	    n < scratch.capacity())
+	{
+		scratch = std::vector<T>();
+	}
+	scratch.resize(n);
+	return scratch.data();
+}
+
+/* The components to export, converted if they have another type. */
+template <typename C, typename E>
+const E* ToExported(const C *in, size_t, std::true_type)
+{
+	return in;
+}
+
+template <typename C, typename E>
+const E* ToExported(const C *in, size_t n, std::false_type)
+{
+	E *out = Scratch<E>(n);
+	Convert(in, out, n);
+	return out;
+}
+
+NSIType_t RoleTo3fType(const TfToken &role)
+{
+	if (role == HdPrimvarRoleTokens->vector)
+		return NSITypeVector;
+	if (role == HdPrimvarRoleTokens->normal)
+		return NSITypeNormal;
+	if (role == HdPrimvarRoleTokens->point)
+		return NSITypePoint;
+	/* HdPrimvarRoleTokens->color, also default. */
+	return NSITypeColor;
+}
+
+template <typename T>
+void Fill(
+	NSI::Argument &arg,
+	const T &value,
+	const TfToken &role,
+	HdNSIValueTypes::Use use)
+{
+	typedef HdNSIValueType<T> Type;
+	typedef typename Type::Component Component;
+	typedef typename Type::Exported Exported;
+
+	size_t count = ElementCount(value);
+	size_t n = count * Type::k_components;
+	const Exported *data = ToExported<Component, Exported>(
+		reinterpret_cast<const Component*>(Elements(value)), n,
+		std::is_same<Component, Exported>());
+
+	NSIType_t type = Type::k_role ? RoleTo3fType(role) : Type::k_type;
+	if (Type::k_array && Type::k_array_length == 0 &&
+	    use == HdNSIValueTypes::k_shader_parameter)
+	{
+		arg.SetArrayType(type, count);
+	}
+	else
+	{
+		if (Type::k_array_length != 0)
+			arg.SetArrayType(type, Type::k_array_length);
+		else
+			arg.SetType(type);
+		if (Type::k_array)
+			arg.SetCount(count);
+	}
+
+	/* Parameters are sent together, after the scratch buffer is reused. */
+	if (use == HdNSIValueTypes::k_shader_parameter)
+		arg.CopyValue(data, n * sizeof(Exported));
+	else
+		arg.SetValuePointer(data);
+}
+
+/* Hash the content of values, the same way in every session. */
+template <typename T>
+size_t HashElements(const T *in, size_t n, size_t seed)
+{
+	return ArchHash64(
+		reinterpret_cast<const char*>(in), n * sizeof(T), seed);
+}
+
+size_t HashElements(const TfToken *in, size_t n, size_t seed)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		const std::string &s = in[i].GetString();
+		seed = ArchHash64(s.data(), s.size(), seed);
+	}
+	return seed;
+}
+
+size_t HashElements(const std::string *in, size_t n, size_t seed)
+{
+	for (size_t i = 0; i < n; ++i)
+		seed = ArchHash64(in[i].data(), in[i].size(), seed);
+	return seed;
+}
+
+size_t HashElements(const SdfAssetPath *in, size_t n, size_t seed)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		const std::string &path = in[i].GetResolvedPath();
+		seed = ArchHash64(path.data(), path.size(), seed);
+	}
+	return seed;
+}
+
+template <typename T>
+VtValue FlattenArray(const VtArray<T> &in, const VtIntArray &indices)
+{
+	VtArray<T> out(indices.size());
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		int idx = indices[i];
+		if (idx >= 0 && size_t(idx) < in.size())
+			out[i] = in[idx];
+	}
+	return VtValue(out);
+}
+
+template <typename T>
+VtValue FlattenArray(const T &in, const VtIntArray &)
+{
+	return VtValue(in);
+}
+}
+
+/**
+	\returns
+		true if FillArgument() can export the value.
+*/
+bool HdNSIValueTypes::IsSupported(const VtValue &value)
+{
+	return Dispatch(value, [](const auto &) {}, SupportedTypes());
+}
+
+/**
+	\brief Set the type and value of an NSI argument from a value.
+
+	\param role
+		The primvar role, which gives the NSI type of vectors of 3
+		components. Empty for colors.
+	\param use
+		What the argument is for. Shader parameters copy their value into
+		the argument. Primvars may point to the value, or to a buffer of the
+		calling thread which the next call reuses, so they must be sent
+		before then.
+	\returns
+		false if the value's type is not supported.
+
+	Values of double or half precision are converted to float, except for
+	matrices. Booleans are converted to integers.
+*/
+bool HdNSIValueTypes::FillArgument(
+	NSI::Argument &arg,
+	const VtValue &value,
+	const TfToken &role,
+	Use use)
+{
+	return Dispatch(value,
+		[&](const auto &v) { Fill(arg, v, role, use); },
+		SupportedTypes());
+}
+
+/**
+	\brief Expand an indexed array value to one element per index.
+
+	Values which are not arrays, or are not supported, are returned as is.
+*/
+VtValue HdNSIValueTypes::Flatten(
+	const VtValue &value,
+	const VtIntArray &indices)
+{
+	VtValue result;
+	if (indices.empty() ||
+	    !Dispatch(value,
+		[&](const auto &v) { result = FlattenArray(v, indices); },
+		SupportedTypes()))
+	{
+		return value;
+	}
+	return result;
+}
+
+/**
+	\brief Hash a value's type and content.
+
+	Unlike VtValue::GetHash(), the result is the same in every session, so
+	it can key data kept on disk. Only the type of unsupported values is
+	hashed, as they are not exported.
+*/
+size_t HdNSIValueTypes::Hash(const VtValue &value, size_t seed)
+{
+	const std::string type = value.GetTypeName();
+	seed = ArchHash64(type.data(), type.size(), seed);
+	Dispatch(value,
+		[&](const auto &v)
+		{
+			seed = HashElements(Elements(v), ElementCount(v), seed);
+		},
+		SupportedTypes());
+	return seed;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
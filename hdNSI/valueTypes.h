@@ -0,0 +1,120 @@
+#ifndef HDNSI_VALUETYPES_H
+#define HDNSI_VALUETYPES_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/base/vt/value.h>
+#include <pxr/usd/sdf/assetPath.h>
+
+#include <nsi.hpp>
+
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/*
+	How a value type is given to NSI, as a specialization of this template
+	for each supported type. Values of other types are not exported.
+
+	Component is the type of one component of the value (eg. double for a
+	GfVec3d) and Exported the type it is converted to, when they differ.
+	Vectors of 3 components have the NSI type of their primvar's role.
+*/
+template <typename T>
+struct HdNSIValueType
+{
+	static constexpr bool k_supported = false;
+};
+
+template <
+	typename Value,
+	typename ComponentT,
+	typename ExportedT,
+	NSIType_t Type,
+	int ArrayLength = 0,
+	bool Role = false>
+struct HdNSIValueTypeBase
+{
+	typedef Value Element;
+	typedef ComponentT Component;
+	typedef ExportedT Exported;
+	static constexpr bool k_supported = true;
+	static constexpr bool k_array = false;
+	static constexpr NSIType_t k_type = Type;
+	/* Components of a value given as a fixed size array, or 0. */
+	static constexpr int k_array_length = ArrayLength;
+	static constexpr bool k_role = Role;
+	static constexpr size_t k_components = sizeof(Value) / sizeof(Component);
+};
+
+/* An array exports its elements as one value each. */
+template <typename T>
+struct HdNSIValueType<VtArray<T>> : HdNSIValueType<T>
+{
+	static constexpr bool k_array = true;
+};
+
+#define HDNSI_VALUE_TYPE(T, ...) \
+	template <> \
+	struct HdNSIValueType<T> : HdNSIValueTypeBase<T, __VA_ARGS__> {}
+
+HDNSI_VALUE_TYPE(bool, bool, int, NSITypeInteger);
+HDNSI_VALUE_TYPE(int, int, int, NSITypeInteger);
+HDNSI_VALUE_TYPE(GfVec2i, int, int, NSITypeInteger, 2);
+HDNSI_VALUE_TYPE(GfVec3i, int, int, NSITypeInteger, 3);
+HDNSI_VALUE_TYPE(GfVec4i, int, int, NSITypeInteger, 4);
+
+HDNSI_VALUE_TYPE(GfHalf, GfHalf, float, NSITypeFloat);
+HDNSI_VALUE_TYPE(float, float, float, NSITypeFloat);
+HDNSI_VALUE_TYPE(double, double, float, NSITypeFloat);
+HDNSI_VALUE_TYPE(GfVec2h, GfHalf, float, NSITypeFloat, 2);
+HDNSI_VALUE_TYPE(GfVec2f, float, float, NSITypeFloat, 2);
+HDNSI_VALUE_TYPE(GfVec2d, double, float, NSITypeFloat, 2);
+HDNSI_VALUE_TYPE(GfVec3h, GfHalf, float, NSITypeColor, 0, true);
+HDNSI_VALUE_TYPE(GfVec3f, float, float, NSITypeColor, 0, true);
+HDNSI_VALUE_TYPE(GfVec3d, double, float, NSITypeColor, 0, true);
+HDNSI_VALUE_TYPE(GfVec4h, GfHalf, float, NSITypeFloat, 4);
+HDNSI_VALUE_TYPE(GfVec4f, float, float, NSITypeFloat, 4);
+HDNSI_VALUE_TYPE(GfVec4d, double, float, NSITypeFloat, 4);
+
+HDNSI_VALUE_TYPE(GfMatrix4f, float, float, NSITypeMatrix);
+HDNSI_VALUE_TYPE(GfMatrix4d, double, double, NSITypeDoubleMatrix);
+
+HDNSI_VALUE_TYPE(TfToken, TfToken, const char*, NSITypeString);
+HDNSI_VALUE_TYPE(std::string, std::string, const char*, NSITypeString);
+/* The resolved path. */
+HDNSI_VALUE_TYPE(SdfAssetPath, SdfAssetPath, const char*, NSITypeString);
+
+#undef HDNSI_VALUE_TYPE
+
+/*
+	Converts values to NSI arguments, using the types above.
+*/
+class HdNSIValueTypes
+{
+public:
+	enum Use
+	{
+		/* Arrays give one value per element, eg. of a primvar. */
+		k_primvar,
+		/* Arrays give an array parameter of a shader. */
+		k_shader_parameter
+	};
+
+	static bool IsSupported(const VtValue &value);
+
+	static bool FillArgument(
+		NSI::Argument &arg,
+		const VtValue &value,
+		const TfToken &role,
+		Use use);
+
+	static VtValue Flatten(const VtValue &value, const VtIntArray &indices);
+
+	static size_t Hash(const VtValue &value, size_t seed);
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif
+// vim: set softtabstop=0 noexpandtab shiftwidth=4:
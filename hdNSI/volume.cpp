@@ -1,6 +1,8 @@
 #include "volume.h"
 
 #include "field.h"
+#include "frameReport.h"
+#include "renderDelegate.h"
 
 #include <pxr/usd/sdf/assetPath.h>
 
@@ -44,6 +46,9 @@ void HdNSIVolume::Sync(
 	/* Pull top-level NSI state out of the render param. */
 	auto nsiRenderParam = static_cast<HdNSIRenderParam*>(renderParam);
 	NSI::Context &nsi = nsiRenderParam->AcquireSceneForEdit();
+	HdNSIFrameReport::SyncTimer timer(
+		nsiRenderParam->GetRenderDelegate()->GetFrameReport(),
+		HdNSIFrameReport::k_volume);
 
 	/* The base rprim class tracks this but does not update it itself. */
 	if (HdChangeTracker::IsVisibilityDirty(*dirtyBits, GetId()))